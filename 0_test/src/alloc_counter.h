@@ -0,0 +1,53 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <new>
+#include <cstdlib>
+#include <atomic>
+
+// Replacements of the global operator new and delete counting the heap allocations, to check that a call does not
+// allocate once warm. Defines them: include it in one translation unit of the program only, the one with main.
+static std::atomic<size_t> numAllocations(0);
+
+// The deletes are not inlined, GCC would otherwise report the free of a pointer from operator new as mismatched
+#if defined(_MSC_VER)
+#define ALLOC_NOINLINE __declspec(noinline)
+#else
+#define ALLOC_NOINLINE __attribute__((noinline))
+#endif
+
+void* operator new(size_t size)
+{
+	numAllocations++;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+ALLOC_NOINLINE void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+ALLOC_NOINLINE void operator delete[](void* p) noexcept
+{
+	operator delete(p);
+}
+
+// sized forms, called instead of the unsized ones with -fsized-deallocation (default since C++14)
+ALLOC_NOINLINE void operator delete(void* p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+ALLOC_NOINLINE void operator delete[](void* p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+#endif // ALLOC_COUNTER_H
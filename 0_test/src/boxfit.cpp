@@ -0,0 +1,1860 @@
+#include "boxfit.h"
+
+#include <cmath>
+#include <cfloat>
+#include <cstdio>
+#include <algorithm>
+#include <limits>
+#include <array>
+#include <chrono>
+
+using namespace std;
+
+// Range of sizes between two candidates of fitBoxSizeSweep where the lower envelope may have more lines
+struct EnvelopeSegment
+{
+	size_t a;  // offsets of the candidates at the ends
+	size_t b;
+	double sa; // sizes of the ends
+	double sb;
+};
+
+// Scratch buffers reused by the fitters, so that a call does not allocate once they are warm
+struct FitWorkspace
+{
+	vector<float> sorted;
+	vector<int> hypothesis;
+	vector<int> lowest;
+	vector<int> minSteps;
+	vector<int> maxSteps;
+	vector<float> sumA;        // sum of hypothesis[i] * sorted[i] up to each level
+	vector<float> sumB;        // sum of hypothesis[i]^2 up to each level
+	vector<double> sumSquares; // sum of sorted[i]^2 up to each level
+	size_t numVisited = 0;     // hypotheses visited by the last search
+	vector<double> breakpoints;
+	vector<double> uncovered;  // size ranges where the rounded steps break the step ranges
+	vector<int> candidates;    // n steps per candidate hypothesis
+	vector<size_t> order;
+	vector<int> highest;       // largest step of each level, for searches not going down from it
+	vector<double> targetSteps; // step predicted at each level by the assigned planes
+	vector<int> nextUp;        // next steps of each level above and below the prediction
+	vector<int> nextDown;
+	vector<float> siblingCosts; // closed form costs of the children of a last level node
+	vector<int> levelLow;      // fewest boxes at each level within the step ranges
+	vector<int> levelStart;    // first entry of each level in levelCosts and levelFrom
+	vector<double> levelCosts; // cost of the best steps up to each level, per number of boxes
+	vector<int> levelFrom;     // boxes at the previous level of these steps
+	vector<int> levelWindow;   // candidate previous boxes while sweeping a level
+	vector<EnvelopeSegment> segments; // ranges left to split by splitEnvelope
+};
+
+static FitWorkspace& fitWorkspace()
+{
+	static thread_local FitWorkspace workspace;
+	return workspace;
+}
+
+// Copy, sort and normalize the depths to offsets from the minimum depth
+static void sortDepths(vector<float>& sorted, const vector<float>& sizes)
+{
+	sorted.assign(sizes.begin(), sizes.end());
+	sort(sorted.begin(), sorted.end());
+	const float z0 = sorted[0];
+	for (size_t i = 0; i < sorted.size(); ++i)
+		sorted[i] -= z0;
+}
+
+// Size the search buffers for n planes and set the sums of the root hypothesis
+static void initSearch(FitWorkspace& ws, const int n)
+{
+	ws.hypothesis.resize(n);
+	ws.lowest.resize(n);
+	ws.sumA.resize(n);
+	ws.sumB.resize(n);
+	ws.sumSquares.resize(n);
+	ws.hypothesis[0] = 0;
+	ws.sumA[0] = 0.f;
+	ws.sumB[0] = 0.f;
+	ws.sumSquares[0] = 0.;
+	ws.numVisited = 0;
+	for (int i = 1; i < n; ++i)
+		ws.sumSquares[i] = ws.sumSquares[i - 1] + static_cast<double>(ws.sorted[i]) * ws.sorted[i];
+}
+
+// Update the sums with the last step of hypothesis[0, len), in the order the full sums are accumulated
+static inline void accumulateStep(FitWorkspace& ws, const int len)
+{
+	if (len < 2)
+		return;
+	const int i = len - 1;
+	const int step = ws.hypothesis[i];
+	ws.sumA[i] = ws.sumA[i - 1] + step * ws.sorted[i];
+	ws.sumB[i] = ws.sumB[i - 1] + step * step;
+}
+
+// Cost and box size of the complete hypothesis in ws.
+// Return false if it has no valid size or if its cost is certainly above maxCost.
+static bool hypothesisCost(const FitWorkspace& ws, const float minSize, const float maxSize, const float maxCost,
+	float& cost, float& size)
+{
+	const float costEpsilon = 0.001f;
+	const double costTolerance = 1e-5; // relative slack between the closed form and the float cost
+	const int n = static_cast<int>(ws.sorted.size());
+	const int* hypothesis = ws.hypothesis.data();
+	const vector<float>& sorted = ws.sorted;
+
+	// compute best boxSize
+	const float A = ws.sumA[n - 1];
+	const float B = ws.sumB[n - 1];
+	if (B <= costEpsilon)
+		return false;
+	size = max(min(A / B, maxSize), minSize);
+
+	// skip hypotheses whose closed form cost is above maxCost
+	const double C = ws.sumSquares[n - 1];
+	const double approxCost = C - 2. * size * A + static_cast<double>(size) * size * B;
+	if (approxCost - costTolerance * C > maxCost)
+		return false;
+
+	// compute cost
+	cost = 0.f;
+	for (int i = 1; i < n; ++i)
+	{
+		const float diff = sorted[i] - hypothesis[i] * size;
+		cost += diff * diff;
+	}
+	return true;
+}
+
+// Keep the hypothesis if it has a lower cost than the best one, or the same cost and smaller steps
+static void updateBest(const int* hypothesis, const int n, const float cost, const float size,
+	float& bestCost, float& boxSize, vector<int>& bestHypothesis)
+{
+	const float costEpsilon = 0.001f;
+	if (cost < bestCost)
+	{
+		bestCost = cost;
+		boxSize = size;
+		bestHypothesis.assign(hypothesis, hypothesis + n);
+	}
+	else if (fabs(cost - bestCost) <= costEpsilon) // prefer smaller stepSize
+	{
+		bool isMultiple = true;
+		for (int i = 1; i < n; ++i)
+		{
+			if (hypothesis[i] == 0)
+				continue;
+			if (bestHypothesis[i] % hypothesis[i] != 0.f)
+			{
+				isMultiple = false;
+				break;
+			}
+		}
+		if (isMultiple)
+		{
+			bestCost = cost;
+			boxSize = size;
+			bestHypothesis.assign(hypothesis, hypothesis + n);
+		}
+	}
+}
+
+// Score a complete hypothesis and keep it if it improves the best one
+static void scoreHypothesis(const FitWorkspace& ws, const float minSize, const float maxSize,
+	float& bestCost, float& boxSize, vector<int>& bestHypothesis)
+{
+	const float costEpsilon = 0.001f;
+	float cost, size;
+	if (hypothesisCost(ws, minSize, maxSize, bestCost + costEpsilon, cost, size))
+		updateBest(ws.hypothesis.data(), static_cast<int>(ws.sorted.size()), cost, size, bestCost, boxSize, bestHypothesis);
+}
+
+// Closed form costs of the children of a hypothesis of n - 1 planes with sums A and B, from the step
+// last + maxStep down to last + minStep as they are visited. Return their count.
+static size_t lastLevelCosts(vector<float>& costs, const int last, const int minStep, const int maxStep, const float A, const float B,
+	const float depth, const double C, const float minSize, const float maxSize)
+{
+	if (minStep > maxStep)
+		return 0;
+	const size_t count = static_cast<size_t>(maxStep - minStep) + 1;
+	costs.resize(count);
+	lastStepCosts(costs.data(), count, last + maxStep, A, B, depth, static_cast<float>(C), minSize, maxSize);
+	return count;
+}
+
+// The float costs of lastLevelCosts can be off by a few ulps of C. With this slack they never skip a child
+// that the exact check of hypothesisCost would keep.
+static const double siblingTolerance = 1e-4;
+
+// Score the children of hypothesis[0, n - 1), the last level, with steps in [minStep, maxStep].
+// Their closed form costs are computed in SIMD batches and only the ones that could beat or tie bestCost
+// are scored, in the order the search visits them, so the tie-break is unchanged.
+static void scoreLastLevel(FitWorkspace& ws, const int minStep, const int maxStep, const float minSize, const float maxSize,
+	float& bestCost, float& boxSize, vector<int>& bestHypothesis)
+{
+	const float costEpsilon = 0.001f;
+	const int n = static_cast<int>(ws.sorted.size());
+	const int last = ws.hypothesis[n - 2];
+	const double C = ws.sumSquares[n - 1];
+	const size_t count = lastLevelCosts(ws.siblingCosts, last, minStep, maxStep, ws.sumA[n - 2], ws.sumB[n - 2], ws.sorted[n - 1], C, minSize, maxSize);
+	const double slack = siblingTolerance * C;
+	for (size_t k = 0; k < count; ++k)
+	{
+		if (ws.siblingCosts[k] - slack > bestCost + costEpsilon)
+			continue;
+		ws.hypothesis[n - 1] = last + maxStep - static_cast<int>(k);
+		accumulateStep(ws, n);
+		scoreHypothesis(ws, minSize, maxSize, bestCost, boxSize, bestHypothesis);
+	}
+	ws.numVisited += count;
+}
+
+// Move to the next sibling of the current node, or to the next sibling of its closest ancestor that has one.
+// Children are visited from the largest step down, the order in which a stack of pushed hypotheses is popped.
+// Levels below rootLen are fixed. Return false when the whole (sub)tree has been visited.
+static bool nextHypothesis(int* hypothesis, const int* lowest, int& len, const int rootLen = 1)
+{
+	while (len > rootLen && hypothesis[len - 1] == lowest[len - 1])
+		--len;
+	if (len == rootLen)
+		return false;
+	--hypothesis[len - 1];
+	return true;
+}
+
+void fitBoxSize2(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize, const vector<float>& sizes)
+{
+	// Check if there is only 1 plane
+	if (sizes.size() < 2)
+	{
+		boxSize = -1.f;
+		return;
+	}
+
+	// sort depths
+	FitWorkspace& ws = fitWorkspace();
+	vector<float>& sorted = ws.sorted;
+	sortDepths(sorted, sizes);
+
+	const float maxGap = sorted[sorted.size() - 1] - sorted[0];
+	float minGap = FLT_MAX;
+
+	if (sorted.size() == 2)
+		minGap = maxGap;
+	else
+	{
+		for (auto i = 1; i < sorted.size(); i++)
+		{
+			float gap = sorted[i] - sorted[i - 1];
+			if (gap < minGap && gap > minSize)
+				minGap = gap;
+		}
+	}
+	const int minStep = static_cast<int>(minGap / maxSize) + 1;
+	const int maxStep = static_cast<int>(maxGap / minSize);
+
+	if (minStep < 0 || minStep > 10)
+	{
+		printf("Invalid minStep : %d", minStep);
+	}
+
+	if (maxStep < 0 || maxStep > 10)
+	{
+		printf("Invalid maxStep : %d", maxStep);
+	}
+
+	// search all hypotheses depth first
+	const int n = static_cast<int>(sorted.size());
+	initSearch(ws, n);
+	int* hypothesis = ws.hypothesis.data();
+	int* lowest = ws.lowest.data();
+	float bestCost = numeric_limits<float>::max();
+	int len = 1;
+	for (;;)
+	{
+		ws.numVisited++;
+		accumulateStep(ws, len);
+		if (len == n - 1) // complete hypotheses
+			scoreLastLevel(ws, minStep, maxStep, minSize, maxSize, bestCost, boxSize, bestHypothesis);
+		else if (minStep <= maxStep) // descend into the first continuation
+		{
+			lowest[len] = hypothesis[len - 1] + minStep;
+			hypothesis[len] = hypothesis[len - 1] + maxStep;
+			++len;
+			continue;
+		}
+		if (!nextHypothesis(hypothesis, lowest, len))
+			break;
+	}
+}
+
+// Step range used to extend a hypothesis of each length
+static void computeSteps(vector<int>& minSteps, vector<int>& maxSteps, const vector<float>& sorted, const float minSize, const float maxSize)
+{
+	const int n = static_cast<int>(sorted.size());
+	minSteps.resize(n);
+	maxSteps.resize(n);
+	for (int len = 1; len < n; ++len)
+	{
+		const int idPlane1 = max(0, len - 2);
+		const int idPlane2 = min(idPlane1 + 1, n - 1);
+		const float distPlane1 = sorted[idPlane1];
+		const float distPlane2 = sorted[idPlane2];
+		maxSteps[len] = static_cast<int>((distPlane2 - distPlane1) / minSize) + 1;
+		minSteps[len] = static_cast<int>((distPlane2 - distPlane1) / maxSize);
+	}
+}
+
+// Problem and best solution of a search over exactly N planes, kept in fixed-size arrays
+template<int N>
+struct FixedSearch
+{
+	array<float, N> sorted;
+	array<int, N> minSteps;
+	array<int, N> maxSteps;
+	array<int, N> hypothesis;
+	double sumSquares;
+	float minSize;
+	float maxSize;
+	float bestCost;
+	float boxSize;
+	array<int, N> bestHypothesis;
+	size_t numVisited;
+	bool found;
+	vector<float>* siblingCosts;
+};
+
+template<int N>
+static void visitLastLevel(FixedSearch<N>& search, const float A, const float B);
+
+// Visit the hypotheses below hypothesis[0, Len) given its sums A and B. The recursion on Len is
+// resolved at compile time, so the whole search unrolls into N - 1 nested loops.
+template<int N, int Len>
+struct FixedLevel
+{
+	static inline void visit(FixedSearch<N>& search, const float A, const float B)
+	{
+		search.numVisited++;
+		if (Len == N - 1)
+		{
+			visitLastLevel(search, A, B);
+			return;
+		}
+		const int last = search.hypothesis[Len - 1];
+		for (int step = last + search.maxSteps[Len]; step >= last + search.minSteps[Len]; --step)
+		{
+			search.hypothesis[Len] = step;
+			FixedLevel<N, Len + 1>::visit(search, A + step * search.sorted[Len], B + step * step);
+		}
+	}
+};
+
+// Complete hypothesis, same scoring as hypothesisCost and updateBest
+template<int N>
+struct FixedLevel<N, N>
+{
+	static inline void visit(FixedSearch<N>& search, const float A, const float B)
+	{
+		const float costEpsilon = 0.001f;
+		const double costTolerance = 1e-5;
+		search.numVisited++;
+
+		// compute best boxSize
+		if (B <= costEpsilon)
+			return;
+		const float size = max(min(A / B, search.maxSize), search.minSize);
+
+		// skip hypotheses whose closed form cost cannot beat or tie bestCost
+		const double C = search.sumSquares;
+		const double approxCost = C - 2. * size * A + static_cast<double>(size) * size * B;
+		if (approxCost - costTolerance * C > search.bestCost + costEpsilon)
+			return;
+
+		// compute cost
+		float cost = 0.f;
+		for (int i = 1; i < N; ++i)
+		{
+			const float diff = search.sorted[i] - search.hypothesis[i] * size;
+			cost += diff * diff;
+		}
+
+		bool isBetter = cost < search.bestCost;
+		if (!isBetter && fabs(cost - search.bestCost) <= costEpsilon) // prefer smaller stepSize
+		{
+			isBetter = true;
+			for (int i = 1; i < N; ++i)
+			{
+				if (search.hypothesis[i] != 0 && search.bestHypothesis[i] % search.hypothesis[i] != 0)
+					isBetter = false;
+			}
+		}
+		if (isBetter)
+		{
+			search.bestCost = cost;
+			search.boxSize = size;
+			search.bestHypothesis = search.hypothesis;
+			search.found = true;
+		}
+	}
+};
+
+// Children of the last level: the ones whose closed form cost (in SIMD batches) could beat or tie
+// bestCost are visited in order, the others are only counted
+template<int N>
+static void visitLastLevel(FixedSearch<N>& search, const float A, const float B)
+{
+	const float costEpsilon = 0.001f;
+	const int last = search.hypothesis[N - 2];
+	const int maxStep = search.maxSteps[N - 1];
+	vector<float>& costs = *search.siblingCosts;
+	const size_t count = lastLevelCosts(costs, last, search.minSteps[N - 1], maxStep, A, B, search.sorted[N - 1],
+		search.sumSquares, search.minSize, search.maxSize);
+	const double slack = siblingTolerance * search.sumSquares;
+	for (size_t k = 0; k < count; ++k)
+	{
+		if (costs[k] - slack > search.bestCost + costEpsilon)
+		{
+			search.numVisited++;
+			continue;
+		}
+		const int step = last + maxStep - static_cast<int>(k);
+		search.hypothesis[N - 1] = step;
+		FixedLevel<N, N>::visit(search, A + step * search.sorted[N - 1], B + step * step);
+	}
+}
+
+// fitBoxSize on exactly N planes. Return false if no hypothesis has a valid size.
+template<int N>
+static bool fitBoxSizeFixed(float &boxSize, array<int, N>& bestHypothesis, const float minSize, const float maxSize, const float* sizes)
+{
+	// sort depths and normalize to offset from minimum depth
+	FixedSearch<N> search;
+	copy(sizes, sizes + N, search.sorted.begin());
+	sort(search.sorted.begin(), search.sorted.end());
+	const float z0 = search.sorted[0];
+	for (int i = 0; i < N; ++i)
+		search.sorted[i] -= z0;
+
+	// step range of each level, as computeSteps
+	search.sumSquares = 0.;
+	for (int len = 1; len < N; ++len)
+	{
+		const int idPlane1 = max(0, len - 2);
+		const int idPlane2 = min(idPlane1 + 1, N - 1);
+		const float distPlane1 = search.sorted[idPlane1];
+		const float distPlane2 = search.sorted[idPlane2];
+		search.maxSteps[len] = static_cast<int>((distPlane2 - distPlane1) / minSize) + 1;
+		search.minSteps[len] = static_cast<int>((distPlane2 - distPlane1) / maxSize);
+		search.sumSquares += static_cast<double>(search.sorted[len]) * search.sorted[len];
+	}
+
+	// search all hypotheses depth first
+	search.minSize = minSize;
+	search.maxSize = maxSize;
+	search.bestCost = numeric_limits<float>::max();
+	search.bestHypothesis.fill(0);
+	search.hypothesis[0] = 0;
+	search.numVisited = 0;
+	search.found = false;
+	search.siblingCosts = &fitWorkspace().siblingCosts;
+	FixedLevel<N, 1>::visit(search, 0.f, 0.f);
+	fitWorkspace().numVisited = search.numVisited;
+
+	if (!search.found)
+		return false;
+	boxSize = search.boxSize;
+	bestHypothesis = search.bestHypothesis;
+	return true;
+}
+
+template<int N>
+void fitBoxSize(float &boxSize, array<int, N>& bestHypothesis, const float minSize, const float maxSize, const array<float, N>& sizes)
+{
+	fitBoxSizeFixed<N>(boxSize, bestHypothesis, minSize, maxSize, sizes.data());
+}
+
+template void fitBoxSize<3>(float &boxSize, array<int, 3>& bestHypothesis, const float minSize, const float maxSize, const array<float, 3>& sizes);
+template void fitBoxSize<4>(float &boxSize, array<int, 4>& bestHypothesis, const float minSize, const float maxSize, const array<float, 4>& sizes);
+template void fitBoxSize<5>(float &boxSize, array<int, 5>& bestHypothesis, const float minSize, const float maxSize, const array<float, 5>& sizes);
+
+// Run the fixed-size search and copy the hypothesis only if one was found, as the general search does
+template<int N>
+static void fitBoxSizeDispatch(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize, const vector<float>& sizes)
+{
+	array<int, N> hypothesis;
+	if (fitBoxSizeFixed<N>(boxSize, hypothesis, minSize, maxSize, sizes.data()))
+		bestHypothesis.assign(hypothesis.begin(), hypothesis.end());
+}
+
+void fitBoxSize(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize, const vector<float>& sizes)
+{
+	// Check if there is only 1 plane
+	if (sizes.size() < 2)
+	{
+		boxSize = -1.f;
+		return;
+	}
+
+	// plane counts with a compile-time search
+	switch (sizes.size())
+	{
+	case 3:
+		return fitBoxSizeDispatch<3>(boxSize, bestHypothesis, minSize, maxSize, sizes);
+	case 4:
+		return fitBoxSizeDispatch<4>(boxSize, bestHypothesis, minSize, maxSize, sizes);
+	case 5:
+		return fitBoxSizeDispatch<5>(boxSize, bestHypothesis, minSize, maxSize, sizes);
+	default:
+		break;
+	}
+
+	// sort depths
+	FitWorkspace& ws = fitWorkspace();
+	vector<float>& sorted = ws.sorted;
+	sortDepths(sorted, sizes);
+	computeSteps(ws.minSteps, ws.maxSteps, sorted, minSize, maxSize);
+
+	// search all hypotheses depth first
+	const int n = static_cast<int>(sorted.size());
+	initSearch(ws, n);
+	int* hypothesis = ws.hypothesis.data();
+	int* lowest = ws.lowest.data();
+	float bestCost = numeric_limits<float>::max();
+	int len = 1;
+	for (;;)
+	{
+		ws.numVisited++;
+		accumulateStep(ws, len);
+		if (len == n - 1) // complete hypotheses
+			scoreLastLevel(ws, ws.minSteps[len], ws.maxSteps[len], minSize, maxSize, bestCost, boxSize, bestHypothesis);
+		else if (ws.minSteps[len] <= ws.maxSteps[len]) // descend into the first continuation
+		{
+			lowest[len] = hypothesis[len - 1] + ws.minSteps[len];
+			hypothesis[len] = hypothesis[len - 1] + ws.maxSteps[len];
+			++len;
+			continue;
+		}
+		if (!nextHypothesis(hypothesis, lowest, len))
+			break;
+	}
+}
+
+// Lower bound of |d - k * s| for k in [kMin, kMax] and s in [minSize, maxSize]
+static double stepDistanceBound(const double d, const int kMin, const int kMax, const float minSize, const float maxSize)
+{
+	// d is reachable if some k in [d / maxSize, d / minSize] is allowed
+	const int kLow = max(kMin, static_cast<int>(ceil(d / maxSize)));
+	const int kHigh = min(kMax, static_cast<int>(floor(d / minSize)));
+	if (kLow <= kHigh)
+		return 0.;
+
+	// otherwise d lies between the intervals [k * minSize, k * maxSize] of two consecutive steps
+	double dist = numeric_limits<double>::max();
+	const int candidates[2] = {static_cast<int>(floor(d / maxSize)), static_cast<int>(ceil(d / minSize))};
+	for (int c = 0; c < 2; ++c)
+	{
+		const int k = max(kMin, min(kMax, candidates[c]));
+		if (d < k * minSize)
+			dist = min(dist, k * minSize - d);
+		else
+			dist = min(dist, max(0., d - k * maxSize));
+	}
+	return dist;
+}
+
+// Lower bound on the cost of every completion of the partial hypothesis hypothesis[0, len)
+static double partialCostBound(const FitWorkspace& ws, const int len, const float minSize, const float maxSize)
+{
+	const double boundTolerance = 1e-5; // relative slack for float rounding of the leaf cost
+	const vector<float>& sorted = ws.sorted;
+	const int n = static_cast<int>(sorted.size());
+
+	// best fit of the assigned planes over [minSize, maxSize]
+	const double A = ws.sumA[len - 1];
+	const double B = ws.sumB[len - 1];
+	const double C = ws.sumSquares[len - 1];
+	double bound = C;
+	if (B > 0.)
+	{
+		const double size = max(min(A / B, static_cast<double>(maxSize)), static_cast<double>(minSize));
+		bound = max(0., C - 2. * size * A + size * size * B);
+	}
+
+	// each unassigned plane on its own
+	int kMin = ws.hypothesis[len - 1];
+	int kMax = ws.hypothesis[len - 1];
+	for (int i = len; i < n; ++i)
+	{
+		kMin += ws.minSteps[i];
+		kMax += ws.maxSteps[i];
+		const double dist = stepDistanceBound(sorted[i], kMin, kMax, minSize, maxSize);
+		bound += dist * dist;
+	}
+	return bound - boundTolerance * ws.sumSquares[n - 1];
+}
+
+// Same search as fitBoxSize, but each partial hypothesis gets a lower bound on the cost of
+// all its completions and the branch is dropped when it cannot beat (or tie) bestCost.
+// The visiting order is unchanged, hence also the tie-break on the smaller step size.
+void fitBoxSizeBnB(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize, const vector<float>& sizes)
+{
+	// Check if there is only 1 plane
+	if (sizes.size() < 2)
+	{
+		boxSize = -1.f;
+		return;
+	}
+
+	// sort depths
+	FitWorkspace& ws = fitWorkspace();
+	vector<float>& sorted = ws.sorted;
+	sortDepths(sorted, sizes);
+	computeSteps(ws.minSteps, ws.maxSteps, sorted, minSize, maxSize);
+	const int* minSteps = ws.minSteps.data();
+	const int* maxSteps = ws.maxSteps.data();
+
+	// search all hypotheses depth first
+	const float costEpsilon = 0.001f;
+	const int n = static_cast<int>(sorted.size());
+	initSearch(ws, n);
+	int* hypothesis = ws.hypothesis.data();
+	int* lowest = ws.lowest.data();
+	float bestCost = numeric_limits<float>::max();
+	int len = 1;
+	for (;;)
+	{
+		ws.numVisited++;
+		accumulateStep(ws, len);
+
+		// prune partial hypotheses that cannot reach bestCost
+		const bool pruned = bestCost < numeric_limits<float>::max() && len > 1 &&
+			partialCostBound(ws, len, minSize, maxSize) > bestCost + costEpsilon;
+		if (!pruned)
+		{
+			if (len == n) // complete hypothesis
+				scoreHypothesis(ws, minSize, maxSize, bestCost, boxSize, bestHypothesis);
+			else if (minSteps[len] <= maxSteps[len]) // descend into the first continuation
+			{
+				lowest[len] = hypothesis[len - 1] + minSteps[len];
+				hypothesis[len] = hypothesis[len - 1] + maxSteps[len];
+				++len;
+				continue;
+			}
+		}
+		if (!nextHypothesis(hypothesis, lowest, len))
+			break;
+	}
+}
+
+size_t lastFitVisitedHypotheses()
+{
+	return fitWorkspace().numVisited;
+}
+
+ThreadPool& defaultThreadPool()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void fitBoxSizeBatch(vector<BoxFitResult>& results, const vector<BoxFitInput>& inputs, ThreadPool& pool)
+{
+	results.resize(inputs.size());
+	pool.parallelFor(inputs.size(), [&](size_t i)
+	{
+		fitBoxSize(results[i].boxSize, results[i].bestHypothesis, inputs[i].minSize, inputs[i].maxSize, inputs[i].sizes);
+	});
+}
+
+// Lower the shared cost without locking
+static void atomicMin(atomic<float>& value, const float candidate)
+{
+	float current = value.load(memory_order_relaxed);
+	while (candidate < current && !value.compare_exchange_weak(current, candidate, memory_order_relaxed))
+		;
+}
+
+// Complete hypotheses found by one subtree task, in visiting order
+struct SubtreeLeaves
+{
+	vector<float> costs;
+	vector<float> boxSizes;
+	vector<int> hypotheses; // n steps per leaf
+};
+
+// Visit the subtree below hypothesis[0, rootLen) = prefix and keep the leaves within costEpsilon of sharedCost
+// (or below fixedMaxCost if positive), pruning with the same bound as fitBoxSizeBnB.
+static void searchSubtree(SubtreeLeaves& leaves, const int* prefix, const int rootLen, const FitWorkspace& shared,
+	const float minSize, const float maxSize, atomic<float>& sharedCost, const float fixedMaxCost)
+{
+	const float costEpsilon = 0.001f;
+	const int n = static_cast<int>(shared.sorted.size());
+
+	// copy the problem into this thread's workspace
+	FitWorkspace& ws = fitWorkspace();
+	ws.sorted.assign(shared.sorted.begin(), shared.sorted.end());
+	ws.minSteps.assign(shared.minSteps.begin(), shared.minSteps.end());
+	ws.maxSteps.assign(shared.maxSteps.begin(), shared.maxSteps.end());
+	initSearch(ws, n);
+	int* hypothesis = ws.hypothesis.data();
+	int* lowest = ws.lowest.data();
+	for (int len = 1; len <= rootLen; ++len)
+	{
+		hypothesis[len - 1] = prefix[len - 1];
+		accumulateStep(ws, len);
+	}
+
+	leaves.costs.clear();
+	leaves.boxSizes.clear();
+	leaves.hypotheses.clear();
+	int len = rootLen;
+	for (;;)
+	{
+		ws.numVisited++;
+		accumulateStep(ws, len);
+
+		const float maxCost = fixedMaxCost > 0.f ? fixedMaxCost : sharedCost.load(memory_order_relaxed) + costEpsilon;
+		const bool pruned = maxCost < numeric_limits<float>::max() && len > 1 &&
+			partialCostBound(ws, len, minSize, maxSize) > maxCost;
+		if (!pruned)
+		{
+			float cost, size;
+			if (len == n) // complete hypothesis
+			{
+				if (hypothesisCost(ws, minSize, maxSize, maxCost, cost, size) && cost <= maxCost)
+				{
+					leaves.costs.push_back(cost);
+					leaves.boxSizes.push_back(size);
+					leaves.hypotheses.insert(leaves.hypotheses.end(), hypothesis, hypothesis + n);
+					atomicMin(sharedCost, cost);
+				}
+			}
+			else if (ws.minSteps[len] <= ws.maxSteps[len]) // descend into the first continuation
+			{
+				lowest[len] = hypothesis[len - 1] + ws.minSteps[len];
+				hypothesis[len] = hypothesis[len - 1] + ws.maxSteps[len];
+				++len;
+				continue;
+			}
+		}
+		if (!nextHypothesis(hypothesis, lowest, len, rootLen))
+			break;
+	}
+}
+
+// Run search(maxCost) to collect the leaves, then replay them in visiting order with the serial tie-break.
+// maxCost < 0 keeps the leaves within costEpsilon of the lowest cost found while searching. The cost window
+// is widened and the search run again until the replay cannot depend on leaves outside it.
+static void replayLeaves(vector<SubtreeLeaves>& leaves, const int n, float maxCost, atomic<float>& sharedCost,
+	const function<void(float)>& search, float& boxSize, vector<int>& bestHypothesis)
+{
+	const float costEpsilon = 0.001f;
+	for (;;)
+	{
+		search(maxCost);
+		const float minCost = sharedCost.load();
+		if (minCost == numeric_limits<float>::max())
+			return; // no valid hypothesis, as fitBoxSize leaves the outputs untouched
+		if (maxCost < 0.f)
+			maxCost = minCost + costEpsilon;
+
+		// the first leaf with the lowest cost replaces whatever was best before it, replay from there
+		float bestCost = numeric_limits<float>::max();
+		float highestBest = minCost;
+		bool started = false;
+		for (size_t t = 0; t < leaves.size(); ++t)
+		{
+			for (size_t l = 0; l < leaves[t].costs.size(); ++l)
+			{
+				const float cost = leaves[t].costs[l];
+				if (cost > maxCost || (!started && cost != minCost))
+					continue;
+				started = true;
+				updateBest(&leaves[t].hypotheses[l * n], n, cost, leaves[t].boxSizes[l], bestCost, boxSize, bestHypothesis);
+				highestBest = max(highestBest, bestCost);
+			}
+		}
+
+		// ties can raise bestCost, then leaves up to highestBest + costEpsilon matter
+		if (highestBest + costEpsilon <= maxCost)
+			return;
+		maxCost = highestBest + costEpsilon;
+	}
+}
+
+// Same result as fitBoxSize, with the top levels of the hypothesis tree split into tasks run on the pool.
+// Tasks share the lowest cost found so far to prune, and keep every leaf that could still be the best
+// or a tie. The leaves are then replayed in the serial visiting order, so that the tie-break on the
+// smaller step size gives the same (and deterministic) answer.
+void fitBoxSizeParallel(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize, const vector<float>& sizes,
+	ThreadPool& pool)
+{
+	// small trees are not worth splitting
+	if (sizes.size() < 4 || pool.size() < 2)
+	{
+		fitBoxSize(boxSize, bestHypothesis, minSize, maxSize, sizes);
+		return;
+	}
+
+	// sort depths
+	FitWorkspace shared;
+	sortDepths(shared.sorted, sizes);
+	computeSteps(shared.minSteps, shared.maxSteps, shared.sorted, minSize, maxSize);
+	const int n = static_cast<int>(shared.sorted.size());
+
+	// split the tree at the shallowest level with enough subtrees, in visiting order
+	const size_t minTasks = 4 * pool.size();
+	vector<int> prefixes;
+	int rootLen = 1;
+	while (rootLen < n - 1 && prefixes.size() / rootLen < minTasks)
+	{
+		rootLen++;
+		prefixes.clear();
+		initSearch(shared, n);
+		int* hypothesis = shared.hypothesis.data();
+		int* lowest = shared.lowest.data();
+		int len = 1;
+		for (;;)
+		{
+			if (len == rootLen)
+				prefixes.insert(prefixes.end(), hypothesis, hypothesis + rootLen);
+			else if (shared.minSteps[len] <= shared.maxSteps[len])
+			{
+				lowest[len] = hypothesis[len - 1] + shared.minSteps[len];
+				hypothesis[len] = hypothesis[len - 1] + shared.maxSteps[len];
+				++len;
+				continue;
+			}
+			if (!nextHypothesis(hypothesis, lowest, len))
+				break;
+		}
+	}
+	const size_t numTasks = prefixes.size() / rootLen;
+
+	// collect the candidate leaves on the pool
+	vector<SubtreeLeaves> leaves(numTasks);
+	atomic<float> sharedCost(numeric_limits<float>::max());
+	replayLeaves(leaves, n, -1.f, sharedCost, [&](const float maxCost)
+	{
+		pool.parallelFor(numTasks, [&](size_t t)
+		{
+			searchSubtree(leaves[t], &prefixes[t * rootLen], rootLen, shared, minSize, maxSize, sharedCost, maxCost);
+		});
+	}, boxSize, bestHypothesis);
+}
+
+// Steps within the step ranges of fitBoxSize, with at least one box, closest to sorted / s in the least-squares
+// sense. Dynamic programming over the number of boxes at each level, in O(n * boxes).
+// Return false if the step ranges allow no hypothesis.
+static bool nearestFeasibleSteps(FitWorkspace& ws, const double s, int* hypothesis)
+{
+	const int n = static_cast<int>(ws.sorted.size());
+	vector<int>& low = ws.levelLow;
+	vector<int>& start = ws.levelStart;
+	low.resize(n);
+	start.resize(n + 1);
+	low[0] = 0;
+	start[0] = 0;
+	start[1] = 1;
+	int high = 0;
+	for (int i = 1; i < n; ++i)
+	{
+		if (ws.minSteps[i] > ws.maxSteps[i])
+			return false;
+		low[i] = low[i - 1] + ws.minSteps[i];
+		high += ws.maxSteps[i];
+		start[i + 1] = start[i] + high - low[i] + 1;
+	}
+	if (high < 1)
+		return false;
+
+	vector<double>& costs = ws.levelCosts;
+	vector<int>& from = ws.levelFrom;
+	costs.resize(start[n]);
+	from.resize(start[n]);
+	costs[0] = 0.;
+	vector<int>& window = ws.levelWindow;
+	window.resize(start[n]);
+	for (int i = 1; i < n; ++i)
+	{
+		// the previous levels reaching h are a window sliding with h: keep the entries that can still be its
+		// minimum, in increasing costs, the one with more boxes on ties as the search visits it first
+		const int prevHigh = low[i - 1] + start[i] - start[i - 1] - 1;
+		int front = 0, back = 0;
+		int next = low[i - 1];
+		for (int e = start[i]; e < start[i + 1]; ++e)
+		{
+			const int h = low[i] + e - start[i];
+			for (const int last = min(h - ws.minSteps[i], prevHigh); next <= last; ++next)
+			{
+				const double cost = costs[start[i - 1] + next - low[i - 1]];
+				while (back > front && costs[start[i - 1] + window[back - 1] - low[i - 1]] >= cost)
+					--back;
+				window[back++] = next;
+			}
+			while (window[front] < h - ws.maxSteps[i])
+				++front;
+			from[e] = window[front];
+			const double diff = ws.sorted[i] - h * s;
+			costs[e] = costs[start[i - 1] + window[front] - low[i - 1]] + diff * diff;
+		}
+	}
+
+	// last plane, which has the most boxes, with at least one, then back to the first
+	int e = start[n - 1] + max(0, 1 - low[n - 1]);
+	for (int k = e + 1; k < start[n]; ++k)
+	{
+		if (costs[k] < costs[e])
+			e = k;
+	}
+	hypothesis[0] = 0;
+	for (int i = n - 1; i > 0; --i)
+	{
+		hypothesis[i] = low[i] + e - start[i];
+		e = start[i - 1] + from[e] - low[i - 1];
+	}
+	return true;
+}
+
+// Slope and intercept of the line B * s - 2 * A, the cost of a hypothesis at size s minus sum(sorted^2), divided by s
+static void costLine(const FitWorkspace& ws, const int* hypothesis, double& A, double& B)
+{
+	A = 0.;
+	B = 0.;
+	for (size_t i = 1; i < ws.sorted.size(); ++i)
+	{
+		A += hypothesis[i] * static_cast<double>(ws.sorted[i]);
+		B += static_cast<double>(hypothesis[i]) * hypothesis[i];
+	}
+}
+
+// Nearest feasible hypotheses of a range of sizes, kept only where they could beat or tie maxCost
+struct EnvelopeSearch
+{
+	FitWorkspace& ws;
+	vector<int>& candidates; // n steps per hypothesis
+	float minSize;
+	float maxSize;
+	double maxCost;          // lowest closed form cost of the candidates, plus the tie and rounding slack
+};
+
+// Lower maxCost with the closed form cost of the candidate at offset c, at its fitted size
+static void boundCandidate(EnvelopeSearch& search, const size_t c)
+{
+	const float costEpsilon = 0.001f;
+	const double boundTolerance = 1e-5; // relative slack for float rounding of the leaf cost
+	double A, B;
+	costLine(search.ws, &search.candidates[c], A, B);
+	if (B <= costEpsilon)
+		return;
+	const double C = search.ws.sumSquares.back();
+	const double size = max(min(static_cast<float>(A / B), search.maxSize), search.minSize);
+	search.maxCost = min(search.maxCost, C - 2. * size * A + size * size * B + costEpsilon + 2. * boundTolerance * C);
+}
+
+// Add the nearest feasible hypotheses of the sizes between those of candidates a (at size sa) and b (at sb).
+// They are the lines of the lower envelope of costLine, so a new one can only show up where two meet.
+// The envelope is concave and above the chord between its ends, which bounds the cost of the range.
+// Each split adds a line strictly below the envelope found so far, so it ends after as many splits as the
+// envelope has lines. The ranges left are kept in a stack, visited in the order of a recursive split.
+static void splitEnvelope(EnvelopeSearch& search, const size_t a, const size_t b, const double sa, const double sb)
+{
+	FitWorkspace& ws = search.ws;
+	vector<int>& candidates = search.candidates;
+	const int n = static_cast<int>(ws.sorted.size());
+	const double C = ws.sumSquares[n - 1];
+	vector<EnvelopeSegment>& segments = ws.segments;
+	segments.clear();
+	const EnvelopeSegment first = {a, b, sa, sb};
+	segments.push_back(first);
+	while (!segments.empty())
+	{
+		const EnvelopeSegment segment = segments.back();
+		segments.pop_back();
+		double Aa, Ba, Ab, Bb;
+		costLine(ws, &candidates[segment.a], Aa, Ba);
+		costLine(ws, &candidates[segment.b], Ab, Bb);
+		if (Ba == Bb)
+			continue; // same or parallel lines, nothing in between
+
+		// lowest cost C + s * chord(s) over the range
+		const double La = Ba * segment.sa - 2. * Aa;
+		const double slope = (Bb * segment.sb - 2. * Ab - La) / (segment.sb - segment.sa);
+		double bound = min(C + segment.sa * La, C + segment.sb * (La + slope * (segment.sb - segment.sa)));
+		if (slope > 0.)
+		{
+			const double vertex = 0.5 * (slope * segment.sa - La) / slope;
+			if (vertex > segment.sa && vertex < segment.sb)
+				bound = min(bound, C + vertex * (La + slope * (vertex - segment.sa)));
+		}
+		if (bound > search.maxCost)
+			continue;
+
+		const double s = 2. * (Aa - Ab) / (Ba - Bb);
+		if (!(s > segment.sa && s < segment.sb))
+			continue;
+		const size_t x = candidates.size();
+		candidates.resize(x + n);
+		nearestFeasibleSteps(ws, s, &candidates[x]);
+		double Ax, Bx;
+		costLine(ws, &candidates[x], Ax, Bx);
+		const double meet = Ba * s - 2. * Aa;
+		if (Bx * s - 2. * Ax >= meet - 1e-9 * (fabs(meet) + C / s))
+		{
+			candidates.resize(x);
+			continue;
+		}
+		boundCandidate(search, x);
+		const EnvelopeSegment right = {x, segment.b, s, segment.sb};
+		const EnvelopeSegment left = {segment.a, x, segment.sa, s};
+		segments.push_back(right);
+		segments.push_back(left);
+	}
+}
+
+// Add the nearest feasible hypotheses (nearestFeasibleSteps) of the sizes in [low, high] that could beat or
+// tie search.maxCost to the candidates. Return false if the step ranges allow no hypothesis.
+static bool nearestFeasibleEnvelope(EnvelopeSearch& search, const double low, const double high)
+{
+	vector<int>& candidates = search.candidates;
+	const int n = static_cast<int>(search.ws.sorted.size());
+	const size_t a = candidates.size();
+	candidates.resize(a + 2 * n);
+	if (!nearestFeasibleSteps(search.ws, low, &candidates[a]))
+	{
+		candidates.resize(a);
+		return false;
+	}
+	nearestFeasibleSteps(search.ws, high, &candidates[a + n]);
+	boundCandidate(search, a);
+	if (equal(candidates.begin() + a, candidates.begin() + a + n, candidates.begin() + a + n))
+		candidates.resize(a + n);
+	else
+	{
+		boundCandidate(search, a + n);
+		splitEnvelope(search, a, a + n, low, high);
+	}
+	return true;
+}
+
+// For a fixed box size s the best step of each plane is round(sorted[i] / s), and the rounded
+// steps only change at s = sorted[i] / (k + 0.5). Between two such breakpoints the rounded
+// hypothesis is constant, and the best hypothesis of the whole search is the rounded one of the
+// interval that contains its size (re-fitting the size can only lower the cost). Scoring one
+// hypothesis per interval gives the optimum in O(n * number of intervals).
+// Where rounded steps break the step ranges of fitBoxSize, or are all 0, the intervals get the closest
+// steps within the ranges of each of their sizes instead (nearestFeasibleEnvelope), a few dynamic programs
+// per hypothesis found, so the cost stays polynomial. The candidates are scored in the serial visiting order
+// to reproduce the tie-break.
+void fitBoxSizeSweep(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize, const vector<float>& sizes)
+{
+	// Check if there is only 1 plane
+	if (sizes.size() < 2)
+	{
+		boxSize = -1.f;
+		return;
+	}
+
+	// sort depths
+	FitWorkspace& ws = fitWorkspace();
+	vector<float>& sorted = ws.sorted;
+	sortDepths(sorted, sizes);
+	computeSteps(ws.minSteps, ws.maxSteps, sorted, minSize, maxSize);
+	const int n = static_cast<int>(sorted.size());
+	initSearch(ws, n);
+
+	// sizes where the rounded step of a plane changes
+	vector<double>& breakpoints = ws.breakpoints;
+	breakpoints.clear();
+	breakpoints.push_back(minSize);
+	breakpoints.push_back(maxSize);
+	for (int i = 1; i < n; ++i)
+	{
+		const int kMin = max(0, static_cast<int>(floor(sorted[i] / maxSize - 0.5)));
+		const int kMax = static_cast<int>(ceil(sorted[i] / minSize - 0.5));
+		for (int k = kMin; k <= kMax; ++k)
+		{
+			const double s = sorted[i] / (k + 0.5);
+			if (s > minSize && s < maxSize)
+				breakpoints.push_back(s);
+		}
+	}
+	sort(breakpoints.begin(), breakpoints.end());
+	breakpoints.erase(unique(breakpoints.begin(), breakpoints.end()), breakpoints.end());
+
+	// rounded hypothesis of each interval where it fits the step ranges
+	vector<int>& candidates = ws.candidates;
+	vector<double>& uncovered = ws.uncovered;
+	candidates.clear();
+	uncovered.clear();
+	const size_t numIntervals = max<size_t>(1, breakpoints.size() - 1);
+	for (size_t j = 0; j < numIntervals; ++j)
+	{
+		const double low = breakpoints[j];
+		const double high = breakpoints[min(j + 1, breakpoints.size() - 1)];
+		const double s = 0.5 * (low + high);
+		const size_t first = candidates.size();
+		candidates.push_back(0);
+		bool valid = true;
+		for (int i = 1; i < n; ++i)
+		{
+			const int step = static_cast<int>(floor(sorted[i] / s + 0.5));
+			const int increment = step - candidates[first + i - 1];
+			valid = valid && increment >= ws.minSteps[i] && increment <= ws.maxSteps[i];
+			candidates.push_back(step);
+		}
+		if (!valid || candidates.back() == 0)
+		{
+			// merged with the previous interval if it was not covered either
+			candidates.resize(first);
+			if (!uncovered.empty() && uncovered.back() == low)
+				uncovered.back() = high;
+			else
+			{
+				uncovered.push_back(low);
+				uncovered.push_back(high);
+			}
+			continue;
+		}
+
+		// neighbour intervals often give the same hypothesis
+		if (first > 0 && equal(candidates.begin() + first, candidates.end(), candidates.begin() + first - n))
+			candidates.resize(first);
+	}
+
+	// nearest hypotheses within the step ranges elsewhere, if they could beat or tie the rounded ones
+	EnvelopeSearch search = {ws, candidates, minSize, maxSize, numeric_limits<double>::max()};
+	for (size_t c = 0; c < candidates.size(); c += n)
+		boundCandidate(search, c);
+	for (size_t u = 0; u < uncovered.size(); u += 2)
+	{
+		if (!nearestFeasibleEnvelope(search, uncovered[u], uncovered[u + 1]))
+		{
+			candidates.clear(); // no hypothesis at all
+			break;
+		}
+	}
+
+	// score the candidates in the order fitBoxSize visits them (larger steps first), for the same tie-break
+	const size_t numCandidates = candidates.size() / n;
+	vector<size_t>& order = ws.order;
+	order.resize(numCandidates);
+	for (size_t c = 0; c < numCandidates; ++c)
+		order[c] = c;
+	const int* steps = candidates.data();
+	sort(order.begin(), order.end(), [steps, n](const size_t a, const size_t b)
+	{
+		return lexicographical_compare(steps + b * n, steps + (b + 1) * n, steps + a * n, steps + (a + 1) * n);
+	});
+
+	float bestCost = numeric_limits<float>::max();
+	for (size_t c = 0; c < numCandidates; ++c)
+	{
+		copy(steps + order[c] * n, steps + (order[c] + 1) * n, ws.hypothesis.begin());
+		for (int len = 2; len <= n; ++len)
+			accumulateStep(ws, len);
+		scoreHypothesis(ws, minSize, maxSize, bestCost, boxSize, bestHypothesis);
+	}
+	ws.numVisited = numCandidates;
+}
+
+// Budget of an anytime fit, shared by its search passes
+struct SearchBudget
+{
+	size_t maxNodes;
+	bool hasDeadline;
+	chrono::steady_clock::time_point deadline;
+	size_t numVisited;
+	bool exhausted;
+};
+
+// Children range of hypothesis[len] and the step predicted by the box size that fits the assigned planes best
+static void startLevel(FitWorkspace& ws, const int len, const float minSize, const float maxSize)
+{
+	const int last = ws.hypothesis[len - 1];
+	ws.lowest[len] = last + ws.minSteps[len];
+	ws.highest[len] = last + ws.maxSteps[len];
+	const double A = ws.sumA[len - 1];
+	const double B = ws.sumB[len - 1];
+	const double size = B > 0. ? max(min(A / B, static_cast<double>(maxSize)), static_cast<double>(minSize)) : 0.5 * (minSize + maxSize);
+	const double target = min(max(ws.sorted[len] / size, static_cast<double>(ws.lowest[len])), static_cast<double>(ws.highest[len]));
+	ws.targetSteps[len] = target;
+	ws.nextDown[len] = static_cast<int>(floor(target));
+	ws.nextUp[len] = ws.nextDown[len] + 1;
+}
+
+// Set hypothesis[len] to the remaining step closest to the prediction. Return false when all were visited.
+static bool nextNearestStep(FitWorkspace& ws, const int len)
+{
+	int& up = ws.nextUp[len];
+	int& down = ws.nextDown[len];
+	const bool hasUp = up <= ws.highest[len];
+	const bool hasDown = down >= ws.lowest[len];
+	if (!hasUp && !hasDown)
+		return false;
+	const double target = ws.targetSteps[len];
+	if (hasUp && (!hasDown || up - target <= target - down))
+		ws.hypothesis[len] = up++;
+	else
+		ws.hypothesis[len] = down--;
+	return true;
+}
+
+// Depth first search visiting the steps nearest to the predicted multiple first, pruned with the bound of
+// fitBoxSizeBnB. Keeps the leaves within costEpsilon of bestCost (or below fixedMaxCost if positive).
+// Stops when the budget is exhausted.
+static void searchNearestFirst(SubtreeLeaves& leaves, FitWorkspace& ws, const float minSize, const float maxSize,
+	const float fixedMaxCost, float& bestCost, SearchBudget& budget)
+{
+	const float costEpsilon = 0.001f;
+	const int n = static_cast<int>(ws.sorted.size());
+	initSearch(ws, n);
+	int* hypothesis = ws.hypothesis.data();
+	leaves.costs.clear();
+	leaves.boxSizes.clear();
+	leaves.hypotheses.clear();
+	size_t compactSize = 256;
+	int len = 1;
+	for (;;)
+	{
+		// the clock is only read every 256 hypotheses
+		if ((budget.maxNodes > 0 && budget.numVisited >= budget.maxNodes) ||
+			(budget.hasDeadline && (budget.numVisited & 255) == 255 && chrono::steady_clock::now() > budget.deadline))
+		{
+			budget.exhausted = true;
+			return;
+		}
+		budget.numVisited++;
+		accumulateStep(ws, len);
+
+		const float maxCost = fixedMaxCost > 0.f ? fixedMaxCost : bestCost + costEpsilon;
+		const bool pruned = maxCost < numeric_limits<float>::max() && len > 1 &&
+			partialCostBound(ws, len, minSize, maxSize) > maxCost;
+		if (!pruned)
+		{
+			float cost, size;
+			if (len == n) // complete hypothesis
+			{
+				if (hypothesisCost(ws, minSize, maxSize, maxCost, cost, size) && cost <= maxCost)
+				{
+					leaves.costs.push_back(cost);
+					leaves.boxSizes.push_back(size);
+					leaves.hypotheses.insert(leaves.hypotheses.end(), hypothesis, hypothesis + n);
+					bestCost = min(bestCost, cost);
+				}
+
+				// drop the leaves a better one has pushed out of the window
+				if (leaves.costs.size() >= compactSize)
+				{
+					const float keepCost = fixedMaxCost > 0.f ? fixedMaxCost : bestCost + costEpsilon;
+					size_t kept = 0;
+					for (size_t l = 0; l < leaves.costs.size(); ++l)
+					{
+						if (leaves.costs[l] > keepCost)
+							continue;
+						leaves.costs[kept] = leaves.costs[l];
+						leaves.boxSizes[kept] = leaves.boxSizes[l];
+						copy(leaves.hypotheses.begin() + l * n, leaves.hypotheses.begin() + (l + 1) * n, leaves.hypotheses.begin() + kept * n);
+						kept++;
+					}
+					leaves.costs.resize(kept);
+					leaves.boxSizes.resize(kept);
+					leaves.hypotheses.resize(kept * n);
+					compactSize = max<size_t>(256, 2 * kept);
+				}
+			}
+			else if (ws.minSteps[len] <= ws.maxSteps[len]) // descend into the nearest continuation
+			{
+				startLevel(ws, len, minSize, maxSize);
+				nextNearestStep(ws, len);
+				++len;
+				continue;
+			}
+		}
+
+		// next sibling of the current node or of its closest ancestor that has one
+		while (len > 1 && !nextNearestStep(ws, len - 1))
+			--len;
+		if (len == 1)
+			return;
+	}
+}
+
+// Reorder the leaves as fitBoxSize visits them (larger steps first), for its tie-break
+static void sortVisitingOrder(SubtreeLeaves& leaves, const int n, vector<size_t>& order)
+{
+	const size_t numLeaves = leaves.costs.size();
+	order.resize(numLeaves);
+	for (size_t l = 0; l < numLeaves; ++l)
+		order[l] = l;
+	const int* steps = leaves.hypotheses.data();
+	sort(order.begin(), order.end(), [steps, n](const size_t a, const size_t b)
+	{
+		return lexicographical_compare(steps + b * n, steps + (b + 1) * n, steps + a * n, steps + (a + 1) * n);
+	});
+
+	SubtreeLeaves sorted;
+	sorted.costs.resize(numLeaves);
+	sorted.boxSizes.resize(numLeaves);
+	sorted.hypotheses.resize(numLeaves * n);
+	for (size_t l = 0; l < numLeaves; ++l)
+	{
+		sorted.costs[l] = leaves.costs[order[l]];
+		sorted.boxSizes[l] = leaves.boxSizes[order[l]];
+		copy(steps + order[l] * n, steps + (order[l] + 1) * n, sorted.hypotheses.begin() + l * n);
+	}
+	swap(leaves, sorted);
+}
+
+// The leaves found within the budget are replayed in the visiting order of fitBoxSize, so a search that ends in
+// time returns its result. A later pass widening the cost window for the replay only replaces the leaves if it ends.
+AnytimeFitStatus fitBoxSizeAnytime(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize, const vector<float>& sizes,
+	const size_t maxNodes, const double maxMs)
+{
+	AnytimeFitStatus status;
+	status.optimal = true;
+	status.numVisited = 0;
+
+	// Check if there is only 1 plane
+	if (sizes.size() < 2)
+	{
+		boxSize = -1.f;
+		return status;
+	}
+
+	SearchBudget budget;
+	budget.maxNodes = maxNodes;
+	budget.hasDeadline = maxMs > 0.;
+	budget.deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, milli>(maxMs));
+	budget.numVisited = 0;
+	budget.exhausted = false;
+
+	// sort depths
+	FitWorkspace& ws = fitWorkspace();
+	sortDepths(ws.sorted, sizes);
+	computeSteps(ws.minSteps, ws.maxSteps, ws.sorted, minSize, maxSize);
+	const int n = static_cast<int>(ws.sorted.size());
+	ws.highest.resize(n);
+	ws.targetSteps.resize(n);
+	ws.nextUp.resize(n);
+	ws.nextDown.resize(n);
+
+	vector<SubtreeLeaves> leaves(1);
+	SubtreeLeaves pass;
+	bool searched = false;
+	atomic<float> sharedCost(numeric_limits<float>::max());
+	replayLeaves(leaves, n, -1.f, sharedCost, [&](const float maxCost)
+	{
+		if (budget.exhausted)
+			return;
+		float bestCost = sharedCost.load();
+		searchNearestFirst(pass, ws, minSize, maxSize, maxCost, bestCost, budget);
+		if (!budget.exhausted || !searched)
+		{
+			sortVisitingOrder(pass, n, ws.order);
+			swap(leaves[0], pass);
+			atomicMin(sharedCost, bestCost);
+		}
+		searched = true;
+	}, boxSize, bestHypothesis);
+
+	ws.numVisited = budget.numVisited;
+	status.optimal = !budget.exhausted;
+	status.numVisited = budget.numVisited;
+	return status;
+}
+
+// fitBoxSize with the search bounded by the cost of seed on the new depths, as the sweep bounds its fallback.
+// Return false without searching if seed is not a hypothesis of the search or has no valid size.
+static bool fitBoxSizeSeeded(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize, const vector<float>& sizes,
+	const vector<int>& seed)
+{
+	FitWorkspace& ws = fitWorkspace();
+	sortDepths(ws.sorted, sizes);
+	computeSteps(ws.minSteps, ws.maxSteps, ws.sorted, minSize, maxSize);
+	const int n = static_cast<int>(ws.sorted.size());
+	if (static_cast<int>(seed.size()) != n || seed[0] != 0)
+		return false;
+	for (int i = 1; i < n; ++i)
+	{
+		const int increment = seed[i] - seed[i - 1];
+		if (increment < ws.minSteps[i] || increment > ws.maxSteps[i])
+			return false;
+	}
+
+	// score the seed on the new depths
+	initSearch(ws, n);
+	copy(seed.begin(), seed.end(), ws.hypothesis.begin());
+	for (int len = 2; len <= n; ++len)
+		accumulateStep(ws, len);
+	float seedCost, seedSize;
+	if (!hypothesisCost(ws, minSize, maxSize, numeric_limits<float>::max(), seedCost, seedSize))
+		return false;
+
+	// search below it, every hypothesis that could win or tie is kept and replayed
+	const float costEpsilon = 0.001f;
+	FitWorkspace problem;
+	problem.sorted.assign(ws.sorted.begin(), ws.sorted.end());
+	problem.minSteps.assign(ws.minSteps.begin(), ws.minSteps.end());
+	problem.maxSteps.assign(ws.maxSteps.begin(), ws.maxSteps.end());
+	vector<SubtreeLeaves> leaves(1);
+	atomic<float> sharedCost(numeric_limits<float>::max());
+	const int root = 0;
+	replayLeaves(leaves, n, seedCost + costEpsilon, sharedCost, [&](const float maxCost)
+	{
+		searchSubtree(leaves[0], &root, 1, problem, minSize, maxSize, sharedCost, maxCost);
+	}, boxSize, bestHypothesis);
+	return true;
+}
+
+void BoxSizeTracker::fit(float &boxSize, vector<int>& bestHypothesis, const int stackId, const float minSize, const float maxSize, const vector<float>& sizes)
+{
+	// Check if there is only 1 plane
+	if (sizes.size() < 2)
+	{
+		boxSize = -1.f;
+		return;
+	}
+
+	// quantized depths
+	sorted.assign(sizes.begin(), sizes.end());
+	sort(sorted.begin(), sorted.end());
+	key.resize(sorted.size());
+	for (size_t i = 0; i < sorted.size(); ++i)
+		key[i] = static_cast<int>(floor(sorted[i] / quantum + 0.5f));
+
+	Entry& entry = entries[stackId];
+	if (!entry.key.empty() && entry.key == key && entry.minSize == minSize && entry.maxSize == maxSize)
+	{
+		hits++;
+		if (entry.found)
+		{
+			boxSize = entry.boxSize;
+			bestHypothesis.assign(entry.bestHypothesis.begin(), entry.bestHypothesis.end());
+		}
+		return;
+	}
+	misses++;
+
+	// start from the previous solution if it is still a hypothesis of the search
+	float size = 0.f;
+	vector<int> hypothesis;
+	if (entry.found && fitBoxSizeSeeded(size, hypothesis, minSize, maxSize, sizes, entry.bestHypothesis))
+		warmStarts++;
+	else
+		fitBoxSize(size, hypothesis, minSize, maxSize, sizes);
+
+	entry.key.swap(key);
+	entry.minSize = minSize;
+	entry.maxSize = maxSize;
+	entry.found = !hypothesis.empty();
+	if (!entry.found)
+		return; // outputs untouched, as fitBoxSize
+	entry.boxSize = size;
+	entry.bestHypothesis.swap(hypothesis);
+	boxSize = entry.boxSize;
+	bestHypothesis.assign(entry.bestHypothesis.begin(), entry.bestHypothesis.end());
+}
+
+// Problem and state of a fitBoxSizes search. Per plane i the cumulative counts of each size from the first plane
+// and the sums of the normal equations of planes [0, i] are kept, so a gap only adds one term.
+struct MultiSearch
+{
+	int K;
+	int n;
+	vector<float> sorted;
+	float minSize[maxBoxSizes];
+	float maxSize[maxBoxSizes];
+	bool sameAsPrevious[maxBoxSizes]; // interchangeable with size k - 1
+	vector<int> combos;         // admissible counts of the gaps, K per combination
+	vector<size_t> firstCombo;  // combinations of gap i are [firstCombo[i], firstCombo[i + 1])
+	vector<size_t> order;       // visiting order of the combinations of each gap, same layout
+	vector<double> distances;   // distance of each combination to its gap with the sizes of the parent
+	vector<double> gapCosts;    // intervalCosts of the plane below each combination, same layout
+	vector<int> cumulative;     // K per plane
+	vector<double> normal;      // K * K per plane
+	vector<double> rhs;         // K per plane
+	vector<double> sumSquares;
+	vector<double> intervalCosts; // per plane, sum of the distances of planes [1, i] to their depth ranges squared
+	float bestCost;
+	int bestBoxes;
+	float bestSizes[maxBoxSizes];
+	vector<int> bestCumulative;
+	size_t numVisited;
+};
+
+static MultiSearch& multiSearch()
+{
+	static thread_local MultiSearch search;
+	return search;
+}
+
+// Single size fits seeding a fitBoxSizes search, kept to reuse their buffers
+struct MultiSeeds
+{
+	vector<BoxSizeRange> single;
+	MultiBoxFit fit;
+	MultiBoxFit best;
+};
+
+static MultiSeeds& multiSeeds()
+{
+	static thread_local MultiSeeds seeds;
+	return seeds;
+}
+
+// Sizes in their ranges minimizing C - 2 rhs.s + s' normal s. The problem is convex, so the minimum is the best
+// solution with each size either free or at one of its bounds, and the unconstrained one when it is inside the
+// ranges. Sizes no box uses do not change the cost and are left in the middle of their range. Return the minimum cost.
+static double constrainedFit(const MultiSearch& search, const double* normal, const double* rhs, const double C, double* sizes)
+{
+	const int K = search.K;
+	int numStates = 1;
+	for (int k = 0; k < K; ++k)
+		numStates *= 3;
+
+	double best = numeric_limits<double>::max();
+	double s[maxBoxSizes];
+	for (int state = 0; state < numStates; ++state)
+	{
+		// 0 free, 1 at minSize, 2 at maxSize
+		int code = state;
+		int freeSizes[maxBoxSizes];
+		bool isFree[maxBoxSizes];
+		int numFree = 0;
+		bool skip = false;
+		for (int k = 0; k < K; ++k)
+		{
+			const int mode = code % 3;
+			code /= 3;
+			isFree[k] = false;
+			if (normal[k * K + k] <= 0.)
+			{
+				skip = skip || mode != 0;
+				s[k] = 0.5 * (search.minSize[k] + search.maxSize[k]);
+			}
+			else if (mode == 0)
+			{
+				freeSizes[numFree++] = k;
+				isFree[k] = true;
+			}
+			else
+				s[k] = mode == 1 ? search.minSize[k] : search.maxSize[k];
+		}
+		if (skip)
+			continue;
+
+		// free sizes solve their rows of the normal equations with the others fixed
+		double a[maxBoxSizes][maxBoxSizes + 1];
+		for (int r = 0; r < numFree; ++r)
+		{
+			const int row = freeSizes[r];
+			a[r][numFree] = rhs[row];
+			for (int k = 0; k < K; ++k)
+				if (!isFree[k])
+					a[r][numFree] -= normal[row * K + k] * s[k];
+			for (int c = 0; c < numFree; ++c)
+				a[r][c] = normal[row * K + freeSizes[c]];
+		}
+		bool singular = false;
+		for (int c = 0; c < numFree && !singular; ++c)
+		{
+			int pivot = c;
+			for (int r = c + 1; r < numFree; ++r)
+				if (fabs(a[r][c]) > fabs(a[pivot][c]))
+					pivot = r;
+			if (fabs(a[pivot][c]) < 1e-9 * normal[freeSizes[c] * K + freeSizes[c]])
+			{
+				singular = true; // a line of minima, it reaches a bound where another state finds it
+				break;
+			}
+			for (int j = 0; j <= numFree; ++j)
+				swap(a[c][j], a[pivot][j]);
+			for (int r = c + 1; r < numFree; ++r)
+			{
+				const double factor = a[r][c] / a[c][c];
+				for (int j = c; j <= numFree; ++j)
+					a[r][j] -= factor * a[c][j];
+			}
+		}
+		if (singular)
+			continue;
+		bool feasible = true;
+		bool inside = true;
+		for (int r = numFree - 1; r >= 0; --r)
+		{
+			double value = a[r][numFree];
+			for (int c = r + 1; c < numFree; ++c)
+				value -= a[r][c] * s[freeSizes[c]];
+			value /= a[r][r];
+			const int k = freeSizes[r];
+			const double tolerance = 1e-6 * search.maxSize[k];
+			feasible = feasible && value >= search.minSize[k] - tolerance && value <= search.maxSize[k] + tolerance;
+			inside = inside && value > search.minSize[k] && value < search.maxSize[k];
+			s[k] = max(static_cast<double>(search.minSize[k]), min(static_cast<double>(search.maxSize[k]), value));
+		}
+		if (!feasible)
+			continue;
+
+		double cost = C;
+		for (int k = 0; k < K; ++k)
+		{
+			cost -= 2. * rhs[k] * s[k];
+			for (int l = 0; l < K; ++l)
+				cost += s[k] * normal[k * K + l] * s[l];
+		}
+		if (cost < best)
+		{
+			best = cost;
+			copy(s, s + K, sizes);
+		}
+		if (state == 0 && inside)
+			break; // the other states are on the bounds, they cannot do better
+	}
+	return max(0., best);
+}
+
+// Counts of each size whose smallest total height is at most gap + the smallest size and whose largest is more
+// than gap - the largest size, as the step range of fitBoxSize for a single size
+static void addCombos(MultiSearch& search, int* counts, const int k, const double low, const double high, const float gap,
+	const float minAll, const float maxAll)
+{
+	if (k == search.K)
+	{
+		if (high > gap - maxAll)
+			search.combos.insert(search.combos.end(), counts, counts + search.K);
+		return;
+	}
+	for (counts[k] = 0; low + counts[k] * search.minSize[k] <= gap + minAll; ++counts[k])
+		addCombos(search, counts, k + 1, low + counts[k] * search.minSize[k], high + counts[k] * search.maxSize[k], gap, minAll, maxAll);
+}
+
+// Keep the complete hypothesis if it has a lower cost than the best one, or the same cost and less boxes
+static void scoreMultiHypothesis(MultiSearch& search, const double* sizes)
+{
+	const float costEpsilon = 0.001f;
+	const int K = search.K;
+	const int n = search.n;
+	const int* last = &search.cumulative[(n - 1) * K];
+	int boxes = 0;
+	for (int k = 0; k < K; ++k)
+		boxes += last[k];
+	if (boxes == 0)
+		return;
+
+	float cost = 0.f;
+	for (int i = 1; i < n; ++i)
+	{
+		float depth = 0.f;
+		for (int k = 0; k < K; ++k)
+			depth += search.cumulative[i * K + k] * static_cast<float>(sizes[k]);
+		const float diff = search.sorted[i] - depth;
+		cost += diff * diff;
+	}
+	if (cost < search.bestCost - costEpsilon || (cost <= search.bestCost + costEpsilon && boxes < search.bestBoxes))
+	{
+		search.bestCost = cost;
+		search.bestBoxes = boxes;
+		for (int k = 0; k < K; ++k)
+			search.bestSizes[k] = last[k] > 0 ? static_cast<float>(sizes[k]) : -1.f;
+		search.bestCumulative.assign(search.cumulative.begin(), search.cumulative.end());
+	}
+}
+
+// Visit the counts of gap i, nearest first to the gap predicted by the sizes fitted on the planes above
+static void searchGap(MultiSearch& search, const int i, const double* parentSizes)
+{
+	const float costEpsilon = 0.001f;
+	const double boundTolerance = 1e-5; // relative slack for float rounding of the leaf cost
+	const int K = search.K;
+	const float gap = search.sorted[i] - search.sorted[i - 1];
+	const size_t begin = search.firstCombo[i];
+	const size_t end = search.firstCombo[i + 1];
+	const int* previous = &search.cumulative[(i - 1) * K];
+	const double depth = search.sorted[i];
+	const double slack = boundTolerance * search.sumSquares[search.n - 1];
+
+	// each plane is at least as far from its fitted depth as from the depths its boxes can reach: the combinations
+	// this bound already rules out against the best hypothesis, e.g. the single size fit, are neither ordered nor fitted
+	size_t kept = begin;
+	for (size_t j = begin; j < end; ++j)
+	{
+		const int* counts = &search.combos[j * K];
+
+		// a size interchangeable with the previous one is not used first
+		bool redundant = false;
+		for (int k = 1; k < K; ++k)
+			redundant = redundant || (search.sameAsPrevious[k] && previous[k - 1] == 0 && counts[k] > counts[k - 1]);
+		if (redundant)
+			continue;
+
+		int boxes = 0;
+		double lowest = 0., highest = 0., predicted = 0.;
+		for (int k = 0; k < K; ++k)
+		{
+			const int count = previous[k] + counts[k];
+			boxes += count;
+			lowest += count * static_cast<double>(search.minSize[k]);
+			highest += count * static_cast<double>(search.maxSize[k]);
+			predicted += counts[k] * parentSizes[k];
+		}
+		const double outside = depth < lowest ? lowest - depth : (depth > highest ? depth - highest : 0.);
+		const double intervalCost = search.intervalCosts[i - 1] + outside * outside;
+		const double bound = intervalCost - slack;
+		if (bound > search.bestCost + costEpsilon || (bound >= search.bestCost - costEpsilon && boxes >= search.bestBoxes))
+			continue;
+		search.order[kept++] = j;
+		search.distances[j] = fabs(gap - predicted);
+		search.gapCosts[j] = intervalCost;
+	}
+	const double* distances = search.distances.data();
+	sort(search.order.begin() + begin, search.order.begin() + kept, [distances](const size_t a, const size_t b)
+	{
+		return distances[a] < distances[b] || (distances[a] == distances[b] && a < b);
+	});
+
+	int* cumulative = &search.cumulative[i * K];
+	double* normal = &search.normal[i * K * K];
+	double* rhs = &search.rhs[i * K];
+	for (size_t o = begin; o < kept; ++o)
+	{
+		const size_t j = search.order[o];
+		const int* counts = &search.combos[j * K];
+		int boxes = 0;
+		for (int k = 0; k < K; ++k)
+		{
+			cumulative[k] = previous[k] + counts[k];
+			boxes += cumulative[k];
+		}
+
+		// the best hypothesis may have improved since the combination was kept
+		const double intervalBound = search.gapCosts[j] - slack;
+		if (intervalBound > search.bestCost + costEpsilon || (intervalBound >= search.bestCost - costEpsilon && boxes >= search.bestBoxes))
+			continue;
+		search.intervalCosts[i] = search.gapCosts[j];
+		search.numVisited++;
+
+		for (int k = 0; k < K; ++k)
+			rhs[k] = search.rhs[(i - 1) * K + k] + cumulative[k] * depth;
+		for (int k = 0; k < K; ++k)
+			for (int l = 0; l < K; ++l)
+				normal[k * K + l] = search.normal[(i - 1) * K * K + k * K + l] + static_cast<double>(cumulative[k]) * cumulative[l];
+
+		// the planes so far cannot fit better with more planes, and boxes are only added: a branch that can
+		// at most tie the best hypothesis cannot win with as many boxes
+		double sizes[maxBoxSizes];
+		const double bound = constrainedFit(search, normal, rhs, search.sumSquares[i], sizes) - slack;
+		if (bound > search.bestCost + costEpsilon || (bound >= search.bestCost - costEpsilon && boxes >= search.bestBoxes))
+			continue;
+		if (i == search.n - 1)
+			scoreMultiHypothesis(search, sizes);
+		else
+			searchGap(search, i + 1, sizes);
+	}
+}
+
+void fitBoxSizes(MultiBoxFit& fit, const vector<BoxSizeRange>& ranges, const vector<float>& sizes)
+{
+	const int K = static_cast<int>(ranges.size());
+	fit.boxSizes.assign(K, -1.f);
+	fit.counts.clear();
+	fit.cost = -1.f;
+	if (sizes.size() < 2 || K == 0 || K > maxBoxSizes)
+		return;
+
+	// the best fit with a single size bounds the search from the first node
+	MultiSeeds& seeds = multiSeeds();
+	MultiBoxFit& seed = seeds.best;
+	int seedSize = -1;
+	if (K > 1)
+	{
+		seeds.single.resize(1);
+		for (int k = 0; k < K; ++k)
+		{
+			if (k > 0 && ranges[k].minSize == ranges[k - 1].minSize && ranges[k].maxSize == ranges[k - 1].maxSize)
+				continue; // the same fit as size k - 1
+			seeds.single[0] = ranges[k];
+			fitBoxSizes(seeds.fit, seeds.single, sizes);
+			if (seeds.fit.cost >= 0.f && (seedSize < 0 || seeds.fit.cost < seed.cost))
+			{
+				swap(seed, seeds.fit);
+				seedSize = k;
+			}
+		}
+	}
+
+	// sort depths
+	MultiSearch& search = multiSearch();
+	sortDepths(search.sorted, sizes);
+	const int n = static_cast<int>(search.sorted.size());
+	search.K = K;
+	search.n = n;
+	float minAll = numeric_limits<float>::max();
+	float maxAll = 0.f;
+	for (int k = 0; k < K; ++k)
+	{
+		search.minSize[k] = ranges[k].minSize;
+		search.maxSize[k] = ranges[k].maxSize;
+		search.sameAsPrevious[k] = k > 0 && ranges[k].minSize == ranges[k - 1].minSize && ranges[k].maxSize == ranges[k - 1].maxSize;
+		minAll = min(minAll, ranges[k].minSize);
+		maxAll = max(maxAll, ranges[k].maxSize);
+	}
+
+	// admissible counts of each gap
+	search.combos.clear();
+	search.firstCombo.assign(n + 1, 0);
+	int counts[maxBoxSizes];
+	for (int i = 1; i < n; ++i)
+	{
+		search.firstCombo[i] = search.combos.size() / K;
+		addCombos(search, counts, 0, 0., 0., search.sorted[i] - search.sorted[i - 1], minAll, maxAll);
+	}
+	search.firstCombo[n] = search.combos.size() / K;
+	search.order.resize(search.firstCombo[n]);
+	search.distances.resize(search.firstCombo[n]);
+	search.gapCosts.resize(search.firstCombo[n]);
+
+	// first plane at 0 with no boxes
+	search.cumulative.assign(n * K, 0);
+	search.normal.assign(n * K * K, 0.);
+	search.rhs.assign(n * K, 0.);
+	search.sumSquares.resize(n);
+	search.sumSquares[0] = 0.;
+	search.intervalCosts.resize(n);
+	search.intervalCosts[0] = 0.;
+	for (int i = 1; i < n; ++i)
+		search.sumSquares[i] = search.sumSquares[i - 1] + static_cast<double>(search.sorted[i]) * search.sorted[i];
+	search.bestCost = numeric_limits<float>::max();
+	search.bestBoxes = numeric_limits<int>::max();
+	search.numVisited = 0;
+	if (seedSize >= 0)
+	{
+		search.bestCost = seed.cost;
+		search.bestBoxes = 0;
+		search.bestCumulative.assign(n * K, 0);
+		for (int i = 1; i < n; ++i)
+		{
+			search.bestBoxes += seed.counts[i];
+			search.bestCumulative[i * K + seedSize] = search.bestBoxes;
+		}
+		for (int k = 0; k < K; ++k)
+			search.bestSizes[k] = k == seedSize ? seed.boxSizes[0] : -1.f;
+	}
+
+	double rootSizes[maxBoxSizes];
+	for (int k = 0; k < K; ++k)
+		rootSizes[k] = 0.5 * (search.minSize[k] + search.maxSize[k]);
+	searchGap(search, 1, rootSizes);
+	fitWorkspace().numVisited = search.numVisited;
+
+	if (search.bestCost == numeric_limits<float>::max())
+		return;
+	fit.boxSizes.assign(search.bestSizes, search.bestSizes + K);
+	fit.counts.resize(n * K);
+	for (int k = 0; k < K; ++k)
+		fit.counts[k] = 0;
+	for (int i = 1; i < n; ++i)
+		for (int k = 0; k < K; ++k)
+			fit.counts[i * K + k] = search.bestCumulative[i * K + k] - search.bestCumulative[(i - 1) * K + k];
+	fit.cost = search.bestCost;
+}
@@ -0,0 +1,252 @@
+#ifndef BOXFIT_H
+#define BOXFIT_H
+
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include "thread_pool.h"
+
+// Number of the sorted values that are smaller than e, i.e. the index of their lower bound
+template<class T>
+size_t countLessThan(const T* values, const size_t n, const T e)
+{
+	return std::lower_bound(values, values + n, e) - values;
+}
+
+// Branchless scans of small sorted tables with the widest SIMD unit of the CPU (SSE2/AVX2 or NEON)
+size_t countLessThan(const float* values, const size_t n, const float e);
+size_t countLessThan(const int* values, const size_t n, const int e);
+
+// Closed-form cost C - 2 s A + s^2 B of the hypotheses extending one with sums baseA and baseB by the steps
+// firstStep, firstStep - 1, ... (count of them) to the plane at depth, with s = A / B clamped to [minSize, maxSize].
+// Computed in float, 8 (AVX2) or 4 (SSE2/NEON) hypotheses at a time. FLT_MAX where B is 0.
+void lastStepCosts(float* costs, const size_t count, const int firstStep, const float baseA, const float baseB,
+	const float depth, const float C, const float minSize, const float maxSize);
+
+// Sorted copy of a list of values, answering nearest value queries in O(log n)
+template<class T>
+class ClosestValueIndex
+{
+public:
+	ClosestValueIndex() {}
+
+	explicit ClosestValueIndex(const std::vector<T>& list)
+	{
+		reset(list);
+	}
+
+	// Replace the indexed values
+	void reset(const std::vector<T>& list)
+	{
+		sortedList.assign(list.begin(), list.end());
+		std::sort(sortedList.begin(), sortedList.end());
+	}
+
+	bool empty() const
+	{
+		return sortedList.empty();
+	}
+
+	const std::vector<T>& values() const
+	{
+		return sortedList;
+	}
+
+	// Closest value to e, the smaller one if two are as close. The index must not be empty.
+	T closest(const T e) const
+	{
+		// Get lower bound (the first value that does not compare less)
+		if (sortedList.size() <= maxScanSize)
+			return closestAt(countLessThan(sortedList.data(), sortedList.size(), e), e);
+		const auto low = std::lower_bound(sortedList.begin(), sortedList.end(), e);
+		return closestAt(low - sortedList.begin(), e);
+	}
+
+	// Closest value to each of the sorted queries, walking both lists once. The index must not be empty.
+	void closest(std::vector<T>& values, const std::vector<T>& sortedQueries) const
+	{
+		values.resize(sortedQueries.size());
+		size_t low = 0;
+		for (size_t q = 0; q < sortedQueries.size(); ++q)
+		{
+			while (low < sortedList.size() && sortedList[low] < sortedQueries[q])
+				++low;
+			values[q] = closestAt(low, sortedQueries[q]);
+		}
+	}
+
+private:
+	// Up to this size a linear scan is faster than a binary search
+	static const size_t maxScanSize = 64;
+
+	// Closest value to e, given the index of its lower bound
+	T closestAt(const size_t low, const T e) const
+	{
+		if (low == 0)
+			return sortedList[0];
+		if (low == sortedList.size())
+			return sortedList[low - 1];
+		const T above = sortedList[low];
+		const T below = sortedList[low - 1];
+		if (std::abs(above - e) < std::abs(below - e))
+			return above;
+		return below;
+	}
+
+	std::vector<T> sortedList;
+};
+
+// Closest value to e in list, the smaller one if two are as close. The list must not be empty.
+// Use ClosestValueIndex to query the same list more than once.
+template<class T>
+T getClosestElement(const std::vector<T>& list, const T e)
+{
+	return ClosestValueIndex<T>(list).closest(e);
+}
+
+// Pool shared by the parallel fitters when none is given
+ThreadPool& defaultThreadPool();
+
+// Fit the distance between planes (sizes) as integer multiples of a box size in [minSize, maxSize].
+// bestHypothesis[i] is the number of boxes between the first plane and the i-th closest one.
+// boxSize is -1 if there are less than 2 planes.
+void fitBoxSize(float &boxSize, std::vector<int>& bestHypothesis, const float minSize, const float maxSize, const std::vector<float>& sizes);
+
+// fitBoxSize for a plane count known at compile time, searched in fixed-size buffers with unrolled loops.
+// Instantiated for N = 3, 4 and 5. fitBoxSize uses it for these plane counts.
+template<int N>
+void fitBoxSize(float &boxSize, std::array<int, N>& bestHypothesis, const float minSize, const float maxSize, const std::array<float, N>& sizes);
+
+// Same as fitBoxSize, with a single step range derived from the smallest and largest gaps
+void fitBoxSize2(float &boxSize, std::vector<int>& bestHypothesis, const float minSize, const float maxSize, const std::vector<float>& sizes);
+
+// Same result as fitBoxSize, pruning partial hypotheses that cannot beat the best one
+void fitBoxSizeBnB(float &boxSize, std::vector<int>& bestHypothesis, const float minSize, const float maxSize, const std::vector<float>& sizes);
+
+// Same result as fitBoxSize in time polynomial in the number of planes: scores one hypothesis per interval
+// of box sizes where the nearest step of every plane is constant. Where the nearest steps break the step
+// ranges of fitBoxSize, the closest steps within them are found by dynamic programming.
+void fitBoxSizeSweep(float &boxSize, std::vector<int>& bestHypothesis, const float minSize, const float maxSize, const std::vector<float>& sizes);
+
+// Outcome of fitBoxSizeAnytime
+struct AnytimeFitStatus
+{
+	bool optimal;      // the search ended within the budget, the result is the one of fitBoxSize
+	size_t numVisited; // hypotheses visited
+};
+
+// fitBoxSize within a budget of visited hypotheses (maxNodes) and of time (maxMs), 0 for no limit.
+// The step closest to the multiple predicted by the box size of the assigned planes is visited first and
+// branches are pruned as in fitBoxSizeBnB, so good hypotheses are found early. When the budget runs out the
+// best hypothesis found so far is returned (the outputs are untouched if none was found).
+AnytimeFitStatus fitBoxSizeAnytime(float &boxSize, std::vector<int>& bestHypothesis, const float minSize, const float maxSize, const std::vector<float>& sizes,
+	const size_t maxNodes, const double maxMs = 0.);
+
+// Number of hypotheses (partial or complete) visited by the last fitBoxSize, fitBoxSize2, fitBoxSizeBnB,
+// fitBoxSizeSweep, fitBoxSizeAnytime or fitBoxSizes call of this thread
+size_t lastFitVisitedHypotheses();
+
+// Same result as fitBoxSize, searching subtrees of the hypotheses on the pool.
+// Called from a task of a pool, the subtrees are searched on the calling thread.
+void fitBoxSizeParallel(float &boxSize, std::vector<int>& bestHypothesis, const float minSize, const float maxSize, const std::vector<float>& sizes,
+	ThreadPool& pool = defaultThreadPool());
+
+// One stack to fit in a batch
+struct BoxFitInput
+{
+	std::vector<float> sizes;
+	float minSize;
+	float maxSize;
+};
+
+struct BoxFitResult
+{
+	float boxSize;
+	std::vector<int> bestHypothesis;
+};
+
+// Fit all inputs in parallel, results[i] is what fitBoxSize returns for inputs[i]
+void fitBoxSizeBatch(std::vector<BoxFitResult>& results, const std::vector<BoxFitInput>& inputs, ThreadPool& pool = defaultThreadPool());
+
+// Fits the same stacks frame after frame. The result of each stack ID is kept: when the depths of the next
+// frame, quantized to quantum, and the size range are the same, it is returned without searching. Otherwise
+// the previous hypothesis, scored on the new depths, bounds the search from its first node and the result is
+// the one of fitBoxSize. Not thread-safe, use one tracker per thread.
+class BoxSizeTracker
+{
+public:
+	explicit BoxSizeTracker(const float quantum = 1.f) : quantum(quantum) {}
+
+	// fitBoxSize on the sizes of stack stackId
+	void fit(float &boxSize, std::vector<int>& bestHypothesis, const int stackId, const float minSize, const float maxSize, const std::vector<float>& sizes);
+
+	// Drop the result of a stack that is no longer tracked
+	void forget(const int stackId)
+	{
+		entries.erase(stackId);
+	}
+
+	void clear()
+	{
+		entries.clear();
+	}
+
+	// Calls returning the kept result, calls searching and, among them, the ones bounded by the previous hypothesis
+	size_t numHits() const { return hits; }
+	size_t numMisses() const { return misses; }
+	size_t numWarmStarts() const { return warmStarts; }
+
+	void resetCounters()
+	{
+		hits = misses = warmStarts = 0;
+	}
+
+private:
+	struct Entry
+	{
+		std::vector<int> key; // quantized sorted depths
+		float minSize;
+		float maxSize;
+		bool found;           // a hypothesis with a valid size was found
+		float boxSize;
+		std::vector<int> bestHypothesis;
+	};
+
+	float quantum;
+	std::unordered_map<int, Entry> entries;
+	std::vector<float> sorted;
+	std::vector<int> key;
+	size_t hits = 0;
+	size_t misses = 0;
+	size_t warmStarts = 0;
+};
+
+// Range of one box size of fitBoxSizes
+struct BoxSizeRange
+{
+	float minSize;
+	float maxSize;
+};
+
+// Result of fitBoxSizes for K box sizes and n planes
+struct MultiBoxFit
+{
+	std::vector<float> boxSizes; // K sizes, -1 for the sizes no gap uses
+	std::vector<int> counts;     // counts[i * K + k]: boxes of size k between the (i-1)-th and the i-th closest planes, row 0 is 0
+	float cost;                  // sum of squared distances of the planes to the fitted depths
+};
+
+// Maximum number of box sizes of fitBoxSizes
+const int maxBoxSizes = 4;
+
+// Fit the gap between consecutive planes as an integer combination of K box sizes, size k in ranges[k].
+// Gaps are enumerated nearest first from the sizes fitted on the planes above. Starting from the best fit with a
+// single size, a branch is dropped as soon as the distance of its planes to the depths their boxes can reach, then
+// the constrained least-squares cost of its planes, cannot beat the best hypothesis. Sizes with the same range are
+// interchangeable, so size k may only appear once size k - 1 has. On ties the hypothesis with less boxes wins.
+// boxSizes are all -1 if there are less than 2 planes, more than maxBoxSizes ranges or no valid hypothesis.
+void fitBoxSizes(MultiBoxFit& fit, const std::vector<BoxSizeRange>& ranges, const std::vector<float>& sizes);
+
+#endif // BOXFIT_H
@@ -0,0 +1,262 @@
+#include "boxfit.h"
+
+#include <cfloat>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SCAN_X86
+#include "cpu_features.h"
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+// Scalar tail of the scans
+template<class T>
+static size_t countLessThanScalar(const T* values, const size_t begin, const size_t n, const T e)
+{
+	size_t count = 0;
+	for (size_t i = begin; i < n; ++i)
+		count += values[i] < e;
+	return count;
+}
+
+// Scalar tail of lastStepCosts
+static void lastStepCostsScalar(float* costs, const size_t begin, const size_t count, const int firstStep, const float baseA, const float baseB,
+	const float depth, const float C, const float minSize, const float maxSize)
+{
+	for (size_t k = begin; k < count; ++k)
+	{
+		const float step = static_cast<float>(firstStep - static_cast<int>(k));
+		const float A = baseA + step * depth;
+		const float B = baseB + step * step;
+		const float size = std::max(std::min(A / B, maxSize), minSize);
+		costs[k] = B > 0.f ? C - 2.f * size * A + size * size * B : FLT_MAX;
+	}
+}
+
+#if defined(SCAN_X86)
+
+static size_t sumLanes(const __m128i count)
+{
+	int lanes[4];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), count);
+	return static_cast<size_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+}
+
+// Comparison masks are -1 where true, subtracting them counts the matches
+static size_t countLessThanSse(const float* values, const size_t n, const float e)
+{
+	const __m128 ev = _mm_set1_ps(e);
+	__m128i count = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		count = _mm_sub_epi32(count, _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(values + i), ev)));
+	return sumLanes(count) + countLessThanScalar(values, i, n, e);
+}
+
+static size_t countLessThanSse(const int* values, const size_t n, const int e)
+{
+	const __m128i ev = _mm_set1_epi32(e);
+	__m128i count = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		count = _mm_sub_epi32(count, _mm_cmplt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)), ev));
+	return sumLanes(count) + countLessThanScalar(values, i, n, e);
+}
+
+TARGET_AVX2 static size_t countLessThanAvx2(const float* values, const size_t n, const float e)
+{
+	const __m256 ev = _mm256_set1_ps(e);
+	__m256i count = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		count = _mm256_sub_epi32(count, _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(values + i), ev, _CMP_LT_OQ)));
+	const __m128i half = _mm_add_epi32(_mm256_castsi256_si128(count), _mm256_extracti128_si256(count, 1));
+	return sumLanes(half) + countLessThanScalar(values, i, n, e);
+}
+
+TARGET_AVX2 static size_t countLessThanAvx2(const int* values, const size_t n, const int e)
+{
+	const __m256i ev = _mm256_set1_epi32(e);
+	__m256i count = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		count = _mm256_sub_epi32(count, _mm256_cmpgt_epi32(ev, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i))));
+	const __m128i half = _mm_add_epi32(_mm256_castsi256_si128(count), _mm256_extracti128_si256(count, 1));
+	return sumLanes(half) + countLessThanScalar(values, i, n, e);
+}
+
+// Steps firstStep - k of the lanes, then the same operations as the scalar code. Lanes with B = 0 are masked.
+static void lastStepCostsSse(float* costs, const size_t count, const int firstStep, const float baseA, const float baseB,
+	const float depth, const float C, const float minSize, const float maxSize)
+{
+	const __m128 av = _mm_set1_ps(baseA);
+	const __m128 bv = _mm_set1_ps(baseB);
+	const __m128 dv = _mm_set1_ps(depth);
+	const __m128 cv = _mm_set1_ps(C);
+	const __m128 minv = _mm_set1_ps(minSize);
+	const __m128 maxv = _mm_set1_ps(maxSize);
+	const __m128 invalid = _mm_set1_ps(FLT_MAX);
+	const __m128 two = _mm_set1_ps(2.f);
+	__m128i steps = _mm_sub_epi32(_mm_set1_epi32(firstStep), _mm_setr_epi32(0, 1, 2, 3));
+	size_t k = 0;
+	for (; k + 4 <= count; k += 4)
+	{
+		const __m128 step = _mm_cvtepi32_ps(steps);
+		const __m128 A = _mm_add_ps(av, _mm_mul_ps(step, dv));
+		const __m128 B = _mm_add_ps(bv, _mm_mul_ps(step, step));
+		const __m128 size = _mm_max_ps(_mm_min_ps(_mm_div_ps(A, B), maxv), minv);
+		const __m128 cost = _mm_add_ps(_mm_sub_ps(cv, _mm_mul_ps(_mm_mul_ps(two, size), A)), _mm_mul_ps(_mm_mul_ps(size, size), B));
+		const __m128 valid = _mm_cmpgt_ps(B, _mm_setzero_ps());
+		_mm_storeu_ps(costs + k, _mm_or_ps(_mm_and_ps(valid, cost), _mm_andnot_ps(valid, invalid)));
+		steps = _mm_sub_epi32(steps, _mm_set1_epi32(4));
+	}
+	lastStepCostsScalar(costs, k, count, firstStep, baseA, baseB, depth, C, minSize, maxSize);
+}
+
+TARGET_AVX2 static void lastStepCostsAvx2(float* costs, const size_t count, const int firstStep, const float baseA, const float baseB,
+	const float depth, const float C, const float minSize, const float maxSize)
+{
+	const __m256 av = _mm256_set1_ps(baseA);
+	const __m256 bv = _mm256_set1_ps(baseB);
+	const __m256 dv = _mm256_set1_ps(depth);
+	const __m256 cv = _mm256_set1_ps(C);
+	const __m256 minv = _mm256_set1_ps(minSize);
+	const __m256 maxv = _mm256_set1_ps(maxSize);
+	const __m256 invalid = _mm256_set1_ps(FLT_MAX);
+	const __m256 two = _mm256_set1_ps(2.f);
+	__m256i steps = _mm256_sub_epi32(_mm256_set1_epi32(firstStep), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	for (size_t k = 0; k < count; k += 8)
+	{
+		const __m256 step = _mm256_cvtepi32_ps(steps);
+		const __m256 A = _mm256_add_ps(av, _mm256_mul_ps(step, dv));
+		const __m256 B = _mm256_add_ps(bv, _mm256_mul_ps(step, step));
+		const __m256 size = _mm256_max_ps(_mm256_min_ps(_mm256_div_ps(A, B), maxv), minv);
+		const __m256 cost = _mm256_add_ps(_mm256_sub_ps(cv, _mm256_mul_ps(_mm256_mul_ps(two, size), A)), _mm256_mul_ps(_mm256_mul_ps(size, size), B));
+		const __m256 valid = _mm256_cmp_ps(B, _mm256_setzero_ps(), _CMP_GT_OQ);
+		const __m256 result = _mm256_blendv_ps(invalid, cost, valid);
+		if (k + 8 <= count)
+			_mm256_storeu_ps(costs + k, result);
+		else
+		{
+			// the tail stays in AVX code, calling SSE code with dirty upper registers stalls
+			float lanes[8];
+			_mm256_storeu_ps(lanes, result);
+			for (size_t j = 0; j < count - k; ++j)
+				costs[k + j] = lanes[j];
+		}
+		steps = _mm256_sub_epi32(steps, _mm256_set1_epi32(8));
+	}
+}
+
+static bool useAvx2()
+{
+	static const bool supported = cpuHasAvx2();
+	return supported;
+}
+
+size_t countLessThan(const float* values, const size_t n, const float e)
+{
+	return useAvx2() ? countLessThanAvx2(values, n, e) : countLessThanSse(values, n, e);
+}
+
+size_t countLessThan(const int* values, const size_t n, const int e)
+{
+	return useAvx2() ? countLessThanAvx2(values, n, e) : countLessThanSse(values, n, e);
+}
+
+void lastStepCosts(float* costs, const size_t count, const int firstStep, const float baseA, const float baseB,
+	const float depth, const float C, const float minSize, const float maxSize)
+{
+	if (useAvx2())
+		lastStepCostsAvx2(costs, count, firstStep, baseA, baseB, depth, C, minSize, maxSize);
+	else
+		lastStepCostsSse(costs, count, firstStep, baseA, baseB, depth, C, minSize, maxSize);
+}
+
+#elif defined(SCAN_NEON)
+
+// Comparison masks are all ones where true, subtracting them counts the matches
+size_t countLessThan(const float* values, const size_t n, const float e)
+{
+	const float32x4_t ev = vdupq_n_f32(e);
+	int32x4_t count = vdupq_n_s32(0);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		count = vsubq_s32(count, vreinterpretq_s32_u32(vcltq_f32(vld1q_f32(values + i), ev)));
+	int lanes[4];
+	vst1q_s32(lanes, count);
+	return static_cast<size_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3] + countLessThanScalar(values, i, n, e);
+}
+
+size_t countLessThan(const int* values, const size_t n, const int e)
+{
+	const int32x4_t ev = vdupq_n_s32(e);
+	int32x4_t count = vdupq_n_s32(0);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		count = vsubq_s32(count, vreinterpretq_s32_u32(vcltq_s32(vld1q_s32(values + i), ev)));
+	int lanes[4];
+	vst1q_s32(lanes, count);
+	return static_cast<size_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3] + countLessThanScalar(values, i, n, e);
+}
+
+#if defined(__aarch64__)
+// Same operations as the scalar code, 4 lanes at a time. Lanes with B = 0 are masked.
+void lastStepCosts(float* costs, const size_t count, const int firstStep, const float baseA, const float baseB,
+	const float depth, const float C, const float minSize, const float maxSize)
+{
+	const float32x4_t av = vdupq_n_f32(baseA);
+	const float32x4_t bv = vdupq_n_f32(baseB);
+	const float32x4_t dv = vdupq_n_f32(depth);
+	const float32x4_t cv = vdupq_n_f32(C);
+	const float32x4_t minv = vdupq_n_f32(minSize);
+	const float32x4_t maxv = vdupq_n_f32(maxSize);
+	const float32x4_t invalid = vdupq_n_f32(FLT_MAX);
+	const float32x4_t two = vdupq_n_f32(2.f);
+	const int offsets[4] = {0, 1, 2, 3};
+	int32x4_t steps = vsubq_s32(vdupq_n_s32(firstStep), vld1q_s32(offsets));
+	size_t k = 0;
+	for (; k + 4 <= count; k += 4)
+	{
+		const float32x4_t step = vcvtq_f32_s32(steps);
+		const float32x4_t A = vaddq_f32(av, vmulq_f32(step, dv));
+		const float32x4_t B = vaddq_f32(bv, vmulq_f32(step, step));
+		const float32x4_t size = vmaxq_f32(vminq_f32(vdivq_f32(A, B), maxv), minv);
+		const float32x4_t cost = vaddq_f32(vsubq_f32(cv, vmulq_f32(vmulq_f32(two, size), A)), vmulq_f32(vmulq_f32(size, size), B));
+		vst1q_f32(costs + k, vbslq_f32(vcgtq_f32(B, vdupq_n_f32(0.f)), cost, invalid));
+		steps = vsubq_s32(steps, vdupq_n_s32(4));
+	}
+	lastStepCostsScalar(costs, k, count, firstStep, baseA, baseB, depth, C, minSize, maxSize);
+}
+#else
+// 32-bit NEON has no division
+void lastStepCosts(float* costs, const size_t count, const int firstStep, const float baseA, const float baseB,
+	const float depth, const float C, const float minSize, const float maxSize)
+{
+	lastStepCostsScalar(costs, 0, count, firstStep, baseA, baseB, depth, C, minSize, maxSize);
+}
+#endif
+
+#else
+
+size_t countLessThan(const float* values, const size_t n, const float e)
+{
+	return countLessThanScalar(values, 0, n, e);
+}
+
+size_t countLessThan(const int* values, const size_t n, const int e)
+{
+	return countLessThanScalar(values, 0, n, e);
+}
+
+void lastStepCosts(float* costs, const size_t count, const int firstStep, const float baseA, const float baseB,
+	const float depth, const float C, const float minSize, const float maxSize)
+{
+	lastStepCostsScalar(costs, 0, count, firstStep, baseA, baseB, depth, C, minSize, maxSize);
+}
+
+#endif
@@ -0,0 +1,196 @@
+#include "depthplanes.h"
+#include "boxfit.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DEPTH_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DEPTH_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+// Interleaved histograms, consecutive pixels of the same plane would otherwise increment the same counter
+static const int numLanes = 4;
+
+// Scratch buffers reused by fitBoxSizeFromDepth
+struct DepthWorkspace
+{
+	vector<uint32_t> lanes;   // numLanes histograms of numBins + 1 counts, the last one for ignored depths
+	vector<uint32_t> histogram;
+	vector<float> depths;
+	vector<pair<uint32_t, int> > peaks; // pixels around each peak and its bin
+};
+
+static DepthWorkspace& depthWorkspace()
+{
+	static thread_local DepthWorkspace workspace;
+	return workspace;
+}
+
+static int numBins(const PlaneDetectionParams& params)
+{
+	const int minDepth = max<int>(1, params.minDepth);
+	if (params.maxDepth <= minDepth)
+		return 0;
+	return ((params.maxDepth - minDepth - 1) >> params.binShift) + 1;
+}
+
+// Bin of each depth, numBins for the ignored ones. 0 is never valid.
+static inline uint16_t depthBin(const uint16_t depth, const uint16_t minDepth, const uint16_t range, const int binShift, const uint16_t dump)
+{
+	const uint16_t offset = static_cast<uint16_t>(depth - minDepth);
+	return offset < range ? static_cast<uint16_t>(offset >> binShift) : dump;
+}
+
+static void countRows(uint32_t* lanes, const size_t laneSize, const DepthRoi& roi, const PlaneDetectionParams& params, const int bins)
+{
+	const uint16_t minDepth = static_cast<uint16_t>(max<int>(1, params.minDepth));
+	const uint16_t range = static_cast<uint16_t>(params.maxDepth - minDepth);
+	const uint16_t dump = static_cast<uint16_t>(bins);
+	const int binShift = params.binShift;
+	uint32_t* lane0 = lanes;
+	uint32_t* lane1 = lanes + laneSize;
+	uint32_t* lane2 = lanes + 2 * laneSize;
+	uint32_t* lane3 = lanes + 3 * laneSize;
+
+#if defined(DEPTH_SSE2)
+	// offset = depth - minDepth wraps below minDepth, so offset <= range - 1 (unsigned) is the whole range test
+	const __m128i minv = _mm_set1_epi16(static_cast<short>(minDepth));
+	const __m128i lastv = _mm_set1_epi16(static_cast<short>(range - 1));
+	const __m128i dumpv = _mm_set1_epi16(static_cast<short>(dump));
+	const __m128i shiftv = _mm_cvtsi32_si128(binShift);
+	const __m128i zero = _mm_setzero_si128();
+#elif defined(DEPTH_NEON)
+	const uint16x8_t minv = vdupq_n_u16(minDepth);
+	const uint16x8_t lastv = vdupq_n_u16(static_cast<uint16_t>(range - 1));
+	const uint16x8_t dumpv = vdupq_n_u16(dump);
+	const int16x8_t shiftv = vdupq_n_s16(static_cast<int16_t>(-binShift));
+#endif
+
+	for (int y = 0; y < roi.height; ++y)
+	{
+		const uint16_t* row = reinterpret_cast<const uint16_t*>(reinterpret_cast<const uint8_t*>(roi.data) + y * roi.stride);
+		int x = 0;
+#if defined(DEPTH_SSE2) || defined(DEPTH_NEON)
+		uint16_t bin[8];
+		for (; x + 8 <= roi.width; x += 8)
+		{
+#if defined(DEPTH_SSE2)
+			const __m128i offset = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)), minv);
+			const __m128i valid = _mm_cmpeq_epi16(_mm_subs_epu16(offset, lastv), zero);
+			const __m128i bins = _mm_or_si128(_mm_and_si128(valid, _mm_srl_epi16(offset, shiftv)), _mm_andnot_si128(valid, dumpv));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(bin), bins);
+#else
+			const uint16x8_t offset = vsubq_u16(vld1q_u16(row + x), minv);
+			const uint16x8_t valid = vcleq_u16(offset, lastv);
+			vst1q_u16(bin, vbslq_u16(valid, vshlq_u16(offset, shiftv), dumpv));
+#endif
+			lane0[bin[0]]++;
+			lane1[bin[1]]++;
+			lane2[bin[2]]++;
+			lane3[bin[3]]++;
+			lane0[bin[4]]++;
+			lane1[bin[5]]++;
+			lane2[bin[6]]++;
+			lane3[bin[7]]++;
+		}
+#endif
+		for (; x < roi.width; ++x)
+			lane0[depthBin(row[x], minDepth, range, binShift, dump)]++;
+	}
+}
+
+void depthHistogram(vector<uint32_t>& histogram, const DepthRoi& roi, const PlaneDetectionParams& params)
+{
+	const int bins = numBins(params);
+	histogram.assign(bins, 0);
+	if (bins == 0)
+		return;
+
+	vector<uint32_t>& lanes = depthWorkspace().lanes;
+	const size_t laneSize = bins + 1;
+	lanes.assign(numLanes * laneSize, 0);
+	countRows(lanes.data(), laneSize, roi, params, bins);
+	for (int l = 0; l < numLanes; ++l)
+	{
+		const uint32_t* lane = lanes.data() + l * laneSize;
+		for (int b = 0; b < bins; ++b)
+			histogram[b] += lane[b];
+	}
+}
+
+void findPlaneDepths(vector<float>& depths, const vector<uint32_t>& histogram, const PlaneDetectionParams& params)
+{
+	// pixels of a plane spread over a few bins with the sensor noise
+	const int radius = 2;
+	const float binWidth = static_cast<float>(1 << params.binShift);
+	const float firstBin = static_cast<float>(max<int>(1, params.minDepth));
+	const int bins = static_cast<int>(histogram.size());
+	depths.clear();
+
+	// local maxima of the counts summed over the radius, ties to the first bin
+	vector<pair<uint32_t, int> >& peaks = depthWorkspace().peaks;
+	peaks.clear();
+	uint32_t window = 0;
+	for (int b = 0; b < min(radius, bins); ++b)
+		window += histogram[b];
+	uint32_t previous = 0;
+	for (int b = 0; b < bins; ++b)
+	{
+		if (b + radius < bins)
+			window += histogram[b + radius];
+		if (b - radius - 1 >= 0)
+			window -= histogram[b - radius - 1];
+		const uint32_t next = window + (b + radius + 1 < bins ? histogram[b + radius + 1] : 0) - (b - radius >= 0 ? histogram[b - radius] : 0);
+		if (window >= static_cast<uint32_t>(params.minPixels) && window > previous && window >= next)
+			peaks.push_back(make_pair(window, b));
+		previous = window;
+	}
+
+	// strongest peaks first, the weaker ones within minSeparation are dropped
+	sort(peaks.begin(), peaks.end(), [](const pair<uint32_t, int>& a, const pair<uint32_t, int>& b)
+	{
+		return a.first > b.first || (a.first == b.first && a.second < b.second);
+	});
+	const float minBins = params.minSeparation / binWidth;
+	size_t kept = 0;
+	for (size_t p = 0; p < peaks.size(); ++p)
+	{
+		bool separated = true;
+		for (size_t q = 0; q < kept && separated; ++q)
+			separated = abs(peaks[p].second - peaks[q].second) >= minBins;
+		if (separated)
+			peaks[kept++] = peaks[p];
+	}
+	peaks.resize(kept);
+
+	// mean depth of the pixels around each peak, the depths of a bin average to the middle of its integers
+	for (size_t p = 0; p < peaks.size(); ++p)
+	{
+		const int peak = peaks[p].second;
+		double sum = 0.;
+		for (int b = max(0, peak - radius); b <= min(bins - 1, peak + radius); ++b)
+			sum += histogram[b] * static_cast<double>(b);
+		depths.push_back(firstBin + static_cast<float>(sum / peaks[p].first) * binWidth + 0.5f * (binWidth - 1.f));
+	}
+	sort(depths.begin(), depths.end());
+}
+
+void fitBoxSizeFromDepth(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize,
+	const DepthRoi& roi, const PlaneDetectionParams& params)
+{
+	DepthWorkspace& ws = depthWorkspace();
+	depthHistogram(ws.histogram, roi, params);
+	findPlaneDepths(ws.depths, ws.histogram, params);
+	fitBoxSize(boxSize, bestHypothesis, minSize, maxSize, ws.depths);
+}
+
+const vector<float>& lastPlaneDepths()
+{
+	return depthWorkspace().depths;
+}
@@ -0,0 +1,43 @@
+#ifndef DEPTHPLANES_H
+#define DEPTHPLANES_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Region of a 16-bit depth map in millimetres, 0 where the depth is invalid.
+// For a CV_16UC1 cv::Mat roi: {roi.ptr<uint16_t>(), roi.step, roi.cols, roi.rows}.
+struct DepthRoi
+{
+	const uint16_t* data;
+	size_t stride; // bytes between the starts of two rows
+	int width;
+	int height;
+};
+
+struct PlaneDetectionParams
+{
+	uint16_t minDepth = 300;   // depths outside [minDepth, maxDepth) are ignored
+	uint16_t maxDepth = 8000;
+	int binShift = 2;          // histogram bins are 2^binShift mm wide
+	int minPixels = 500;       // pixels a plane must cover
+	float minSeparation = 50.f; // planes closer than this (mm) are merged into the strongest one
+};
+
+// Histogram of the valid depths of roi, bin b counts the depths in [minDepth + b * 2^binShift, minDepth + (b + 1) * 2^binShift).
+// The bin indices are computed 8 pixels at a time (SSE2/NEON) and counted in interleaved histograms.
+void depthHistogram(std::vector<uint32_t>& histogram, const DepthRoi& roi, const PlaneDetectionParams& params);
+
+// Depth of the planes of a histogram, sorted: peaks with at least minPixels around them, the strongest first,
+// at least minSeparation apart. Each depth is the mean of the depths of its peak, so it is finer than a bin.
+void findPlaneDepths(std::vector<float>& depths, const std::vector<uint32_t>& histogram, const PlaneDetectionParams& params);
+
+// fitBoxSize on the planes found in roi. The histogram and the depths are kept in buffers of the calling thread,
+// so a call does not allocate once they are warm. boxSize is -1 if less than 2 planes are found.
+void fitBoxSizeFromDepth(float &boxSize, std::vector<int>& bestHypothesis, const float minSize, const float maxSize,
+	const DepthRoi& roi, const PlaneDetectionParams& params);
+
+// Depths of the planes found by the last fitBoxSizeFromDepth call of this thread
+const std::vector<float>& lastPlaneDepths();
+
+#endif // DEPTHPLANES_H
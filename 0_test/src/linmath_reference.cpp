@@ -0,0 +1,23 @@
+// linmath.h functions are static inline, this translation unit gets their scalar code
+#define LINMATH_NO_SIMD
+#include "linmath_reference.h"
+
+void mat4x4_mul_reference(mat4x4 M, mat4x4 a, mat4x4 b)
+{
+	mat4x4_mul(M, a, b);
+}
+
+void mat4x4_mul_vec4_reference(vec4 r, mat4x4 M, vec4 v)
+{
+	mat4x4_mul_vec4(r, M, v);
+}
+
+void mat4x4_invert_reference(mat4x4 T, mat4x4 M)
+{
+	mat4x4_invert(T, M);
+}
+
+void quat_mul_reference(quat r, quat p, quat q)
+{
+	quat_mul(r, p, q);
+}
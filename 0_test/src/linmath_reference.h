@@ -0,0 +1,13 @@
+#ifndef LINMATH_REFERENCE_H
+#define LINMATH_REFERENCE_H
+
+#include "linmath.h"
+
+// Scalar (LINMATH_NO_SIMD) versions of the vectorized linmath functions, the references of their tests.
+// The outputs must not be the inputs.
+void mat4x4_mul_reference(mat4x4 M, mat4x4 a, mat4x4 b);
+void mat4x4_mul_vec4_reference(vec4 r, mat4x4 M, vec4 v);
+void mat4x4_invert_reference(mat4x4 T, mat4x4 M);
+void quat_mul_reference(quat r, quat p, quat q);
+
+#endif // LINMATH_REFERENCE_H
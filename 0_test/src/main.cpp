@@ -1,40 +1,36 @@
 #include <iostream>
 #include <vector>
-#include <stack>
-#include <cmath>
+#include <array>
+#include <random>
+#include <chrono>
+#include <atomic>
 #include <cfloat>
+#include <thread>
+#include <stack>
+#include <stdexcept>
+#include "alloc_counter.h"
+#include "boxfit.h"
+#include "depthplanes.h"
+#include "frame_queue.h"
+#include "random_stacks.h"
+#include "linmath_batch.h"
+#include "linmath_reference.h"
 
 using namespace std;
 
-template<class T>
-T getClosestElement(const std::vector<T> list, const T e)
+// Same n floats up to the rounding of vectorized code that sums in another order, scale bounds the summed terms
+static bool nearlyEqual(const float* expected, const float* values, const size_t n, const float scale)
 {
-	// Sort vector
-	std::vector<T> sortedList = list;
-	std::sort(sortedList.begin(), sortedList.end());
-
-	// Get lower bound (the first value that does not compare less)
-	const auto low = std::lower_bound(sortedList.begin(), sortedList.end(), e);
-
-	// Get closest value
-	auto value = *low;
-	if (low > sortedList.begin() && low < sortedList.end())
+	for (size_t i = 0; i < n; ++i)
 	{
-		auto above = sortedList[low - sortedList.begin()];
-		auto below = sortedList[low - sortedList.begin() - 1];
-		if (std::abs(above - e) < std::abs(below - e))
-			value = above;
-		else
-			value = below;
+		if (!(fabs(expected[i] - values[i]) <= 1e-6f * scale))
+			return false;
 	}
-	else if (low == sortedList.end())
-		value = sortedList[sortedList.size() - 1];
-
-	// Return closest value
-	return value;
+	return true;
 }
 
-void fitBoxSize2(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize, const vector<float>& sizes)
+// fitBoxSize as it was before the incremental sums, allocation-free search and pruning, the exact reference of them
+static void baselineFitBoxSize(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize, const vector<float>& sizes)
 {
 	// Check if there is only 1 plane
 	if (sizes.size() < 2)
@@ -52,33 +48,6 @@ void fitBoxSize2(float &boxSize, vector<int>& bestHypothesis, const float minSiz
 	for (size_t i = 0; i < sorted.size(); ++i)
 		sorted[i] -= z0;
 
-	const float maxGap = sorted[sorted.size() - 1] - sorted[0];
-	float minGap = FLT_MAX;
-
-	if (sorted.size() == 2)
-		minGap = maxGap;
-	else
-	{
-		for (auto i = 1; i < sorted.size(); i++)
-		{
-			float gap = sorted[i] - sorted[i - 1];
-			if (gap < minGap && gap > minSize)
-				minGap = gap;
-		}
-	}
-	const int minStep = static_cast<int>(minGap / maxSize) + 1;
-	const int maxStep = static_cast<int>(maxGap / minSize);
-
-	if (minStep < 0 || minStep > 10)
-	{
-		printf("Invalid minStep : %d", minStep);
-	}
-
-	if (maxStep < 0 || maxStep > 10)
-	{
-		printf("Invalid maxStep : %d", maxStep);
-	}
-
 	// search all hypotheses
 	const float costEpsilon = 0.001f;
 	float bestCost = numeric_limits<float>::max();
@@ -89,6 +58,12 @@ void fitBoxSize2(float &boxSize, vector<int>& bestHypothesis, const float minSiz
 	{
 		vector<int> top = remaining.top();
 		remaining.pop();
+		const int idPlane1 = max(0, static_cast<int>(top.size()) - 2);
+		const int idPlane2 = min(idPlane1 + 1, static_cast<int>(sorted.size()) - 1);
+		const float distPlane1 = sorted[idPlane1];
+		const float distPlane2 = sorted[idPlane2];
+		const int maxStep = static_cast<int>((distPlane2 - distPlane1) / minSize) + 1;
+		const int minStep = static_cast<int>((distPlane2 - distPlane1) / maxSize);
 		if (top.size() == sorted.size()) // complete hypothesis
 		{
 			// compute best boxSize
@@ -110,7 +85,6 @@ void fitBoxSize2(float &boxSize, vector<int>& bestHypothesis, const float minSiz
 				const float diff = sorted[i] - top[i] * size;
 				cost += diff * diff;
 			}
-
 			if (cost < bestCost)
 			{
 				bestCost = cost;
@@ -150,120 +124,762 @@ void fitBoxSize2(float &boxSize, vector<int>& bestHypothesis, const float minSiz
 	}
 }
 
-void fitBoxSize(float &boxSize, vector<int>& bestHypothesis, const float minSize, const float maxSize, const vector<float>& sizes)
+int main(int argc, char* argv[])
 {
-	// Check if there is only 1 plane
-	if (sizes.size() < 2)
+	if(0)
 	{
-		boxSize = -1.f;
-		return;
+		vector<float> depths = {1083, 1415, 1745, 2079};
+		float boxDepth = 80;
+		printf("%.3f\n", getClosestElement(depths, boxDepth));
 	}
 
-	// sort depths
-	vector<float> sorted = sizes;
-	sort(sorted.begin(), sorted.end());
+	if(1)
+	{
+		vector<float> vec = {0.f, 10.f, 215.f, 800.f, 1100.f};
+		const float minSize = 200.f;
+		const float maxSize = 600.f;
+		vector<int> bestHypothesis;
+		float bestSize;
+		fitBoxSize(bestSize, bestHypothesis, minSize, maxSize, vec);
+		printf("Best fit1: %.1f\n", bestSize);
+		fitBoxSize2(bestSize, bestHypothesis, minSize, maxSize, vec);
+		printf("Best fit2: %.1f\n", bestSize);
+	}
 
-	// normalize to offset from minimum depth
-	const float z0 = sorted[0];
-	for (size_t i = 0; i < sorted.size(); ++i)
-		sorted[i] -= z0;
+	if(1)
+	{
+		// compare branch and bound against the exhaustive search on random stacks
+		mt19937 rng(42);
+		uniform_int_distribution<int> planesDist(2, 6);
+		int mismatches = 0;
+		const int numTests = 500;
+		for (int t = 0; t < numTests; ++t)
+		{
+			const vector<float> depths = makeRandomStack(rng, planesDist(rng), 1, 3, 15.f);
+			const float minSize = 100.f;
+			const float maxSize = 500.f;
+			vector<int> hypothesis1, hypothesis2;
+			float size1 = 0.f, size2 = 0.f;
+			fitBoxSize(size1, hypothesis1, minSize, maxSize, depths);
+			fitBoxSizeBnB(size2, hypothesis2, minSize, maxSize, depths);
+			if (size1 != size2 || hypothesis1 != hypothesis2)
+				mismatches++;
+		}
+		printf("Branch and bound mismatches: %d / %d\n", mismatches, numTests);
+		if (mismatches > 0)
+			return 1;
+	}
 
-	// search all hypotheses
-	const float costEpsilon = 0.001f;
-	float bestCost = numeric_limits<float>::max();
-	stack<vector<int> > remaining;
-	vector<int> initial(1, 0);
-	remaining.push(initial);
-	while (!remaining.empty())
+	if(1)
 	{
-		vector<int> top = remaining.top();
-		remaining.pop();
-		const int idPlane1 = max(0, static_cast<int>(top.size()) - 2);
-		const int idPlane2 = min(idPlane1 + 1, static_cast<int>(sorted.size()) - 1);
-		const float distPlane1 = sorted[idPlane1];
-		const float distPlane2 = sorted[idPlane2];
-		const int maxStep = static_cast<int>((distPlane2 - distPlane1) / minSize) + 1;
-		const int minStep = static_cast<int>((distPlane2 - distPlane1) / maxSize);
-		if (top.size() == sorted.size()) // complete hypothesis
+		// the optimized search returns exactly what the original exhaustive one did
+		mt19937 rng(3);
+		uniform_int_distribution<int> planesDist(2, 6);
+		int mismatches = 0;
+		const int numTests = 200;
+		for (int t = 0; t < numTests; ++t)
 		{
-			// compute best boxSize
-			float A = 0.f;
-			float B = 0.f;
-			for (size_t i = 1; i < top.size(); ++i)
+			const vector<float> depths = makeRandomStack(rng, planesDist(rng), 0, 3, 15.f);
+			const float minSize = t % 2 ? 100.f : 150.f;
+			const float maxSize = 500.f;
+			vector<int> hypothesis1, hypothesis2;
+			float size1 = 0.f, size2 = 0.f;
+			baselineFitBoxSize(size1, hypothesis1, minSize, maxSize, depths);
+			fitBoxSize(size2, hypothesis2, minSize, maxSize, depths);
+			if (size1 != size2 || hypothesis1 != hypothesis2)
+				mismatches++;
+		}
+		printf("Baseline mismatches: %d / %d\n", mismatches, numTests);
+		if (mismatches > 0)
+			return 1;
+	}
+
+	if(1)
+	{
+		// no heap allocations after the first call, for the fixed plane count path (5 planes) and the general one
+		const vector<vector<float> > stacks = {
+			{0.f, 10.f, 215.f, 800.f, 1100.f},
+			{0.f, 205.f, 410.f, 800.f, 1010.f, 1230.f, 1600.f}
+		};
+		const float minSize = 200.f;
+		const float maxSize = 600.f;
+		vector<int> bestHypothesis;
+		float bestSize;
+		auto fitAll = [&]()
+		{
+			for (size_t s = 0; s < stacks.size(); ++s)
 			{
-				A += top[i] * sorted[i];
-				B += top[i] * top[i];
+				fitBoxSize(bestSize, bestHypothesis, minSize, maxSize, stacks[s]);
+				fitBoxSize2(bestSize, bestHypothesis, minSize, maxSize, stacks[s]);
+				fitBoxSizeBnB(bestSize, bestHypothesis, minSize, maxSize, stacks[s]);
+				fitBoxSizeSweep(bestSize, bestHypothesis, minSize, maxSize, stacks[s]);
 			}
-			if (B <= costEpsilon)
-				continue;
-			const float size = max(min(A / B, maxSize), minSize);
+		};
+		fitAll();
+		const size_t allocationsBefore = numAllocations;
+		fitAll();
+		const size_t allocations = numAllocations - allocationsBefore;
+		printf("Allocations after warm-up: %zu\n", allocations);
+		if (allocations > 0)
+			return 1;
+	}
 
-			// compute cost
-			float cost = 0.f;
-			for (size_t i = 1; i < top.size(); ++i)
+	if(1)
+	{
+		// batch fit must match the serial calls
+		mt19937 rng(7);
+		uniform_int_distribution<int> planesDist(1, 7);
+		vector<BoxFitInput> inputs(64);
+		for (size_t t = 0; t < inputs.size(); ++t)
+		{
+			inputs[t].sizes = makeRandomStack(rng, planesDist(rng), 1, 3, 15.f);
+			inputs[t].minSize = 100.f;
+			inputs[t].maxSize = t % 2 ? 500.f : 600.f;
+		}
+		ThreadPool pool(4);
+		vector<BoxFitResult> results;
+		fitBoxSizeBatch(results, inputs, pool);
+		int mismatches = 0;
+		for (size_t t = 0; t < inputs.size(); ++t)
+		{
+			vector<int> bestHypothesis;
+			float bestSize = 0.f;
+			fitBoxSize(bestSize, bestHypothesis, inputs[t].minSize, inputs[t].maxSize, inputs[t].sizes);
+			if (bestSize != results[t].boxSize || bestHypothesis != results[t].bestHypothesis)
+				mismatches++;
+		}
+		printf("Batch mismatches: %d / %zu\n", mismatches, inputs.size());
+		if (mismatches > 0)
+			return 1;
+	}
+
+	if(1)
+	{
+		// parallel search of a single stack must match the serial call
+		mt19937 rng(5);
+		uniform_int_distribution<int> planesDist(2, 8);
+		ThreadPool pool(4);
+		int mismatches = 0;
+		const int numTests = 200;
+		vector<vector<float> > stacks(numTests);
+		vector<BoxFitResult> expected(numTests);
+		for (int t = 0; t < numTests; ++t)
+		{
+			stacks[t] = makeRandomStack(rng, planesDist(rng), 1, 3, 15.f);
+			const vector<float>& depths = stacks[t];
+			vector<int> hypothesis2;
+			float size2 = 0.f;
+			fitBoxSize(expected[t].boxSize, expected[t].bestHypothesis, 100.f, 500.f, depths);
+			fitBoxSizeParallel(size2, hypothesis2, 100.f, 500.f, depths, pool);
+			if (expected[t].boxSize != size2 || expected[t].bestHypothesis != hypothesis2)
+				mismatches++;
+		}
+
+		// the same pool used from its own tasks and from two threads at once
+		atomic<int> shared(0);
+		auto fitAll = [&](const size_t t)
+		{
+			vector<int> hypothesis;
+			float size = 0.f;
+			fitBoxSizeParallel(size, hypothesis, 100.f, 500.f, stacks[t], pool);
+			if (expected[t].boxSize != size || expected[t].bestHypothesis != hypothesis)
+				shared++;
+		};
+		pool.parallelFor(numTests, fitAll);
+		thread other([&]()
+		{
+			for (int t = 0; t < numTests; ++t)
+				fitAll(t);
+		});
+		for (int t = numTests - 1; t >= 0; --t)
+			fitAll(t);
+		other.join();
+		mismatches += shared;
+
+		// a task throwing on the calling thread does not leave the later loops on that thread only
+		const thread::id caller = this_thread::get_id();
+		bool thrown = false;
+		try
+		{
+			pool.parallelFor(64, [&](const size_t)
 			{
-				const float diff = sorted[i] - top[i] * size;
-				cost += diff * diff;
+				if (this_thread::get_id() == caller)
+					throw runtime_error("task");
+				this_thread::sleep_for(chrono::milliseconds(1));
+			});
+		}
+		catch (const runtime_error&)
+		{
+			thrown = true;
+		}
+		atomic<int> onWorkers(0), numRun(0);
+		pool.parallelFor(64, [&](const size_t)
+		{
+			if (this_thread::get_id() != caller)
+				onWorkers++;
+			numRun++;
+			this_thread::sleep_for(chrono::milliseconds(1));
+		});
+		mismatches += !thrown + (onWorkers == 0) + (numRun != 64);
+		printf("Parallel search mismatches: %d / %d\n", mismatches, 4 * numTests + 3);
+		if (mismatches > 0)
+			return 1;
+	}
+
+	if(1)
+	{
+		// closest value index against a linear scan, including queries outside the list
+		mt19937 rng(3);
+		uniform_int_distribution<int> depthDist(0, 5000);
+		vector<int> list(50);
+		for (size_t i = 0; i < list.size(); ++i)
+			list[i] = depthDist(rng);
+		const ClosestValueIndex<int> index(list);
+		vector<int> queries(200);
+		for (size_t q = 0; q < queries.size(); ++q)
+			queries[q] = depthDist(rng) * 2 - 2500;
+		sort(queries.begin(), queries.end());
+		vector<int> batch;
+		index.closest(batch, queries);
+		int mismatches = 0;
+		for (size_t q = 0; q < queries.size(); ++q)
+		{
+			int expected = list[0];
+			for (size_t i = 1; i < list.size(); ++i)
+			{
+				const int dist = abs(list[i] - queries[q]);
+				const int bestDist = abs(expected - queries[q]);
+				if (dist < bestDist || (dist == bestDist && list[i] < expected))
+					expected = list[i];
 			}
-			if (cost < bestCost)
+			if (index.closest(queries[q]) != expected || batch[q] != expected || getClosestElement(list, queries[q]) != expected)
+				mismatches++;
+		}
+		printf("Closest value mismatches: %d / %zu\n", mismatches, queries.size());
+		if (mismatches > 0)
+			return 1;
+	}
+
+	if(1)
+	{
+		// vectorized lower bound of small tables against the binary search
+		mt19937 rng(8);
+		uniform_int_distribution<int> valueDist(-20, 20);
+		int mismatches = 0;
+		for (int n = 0; n <= 70; ++n)
+		{
+			vector<int> ints(n);
+			vector<float> floats(n);
+			for (int i = 0; i < n; ++i)
+				ints[i] = valueDist(rng);
+			sort(ints.begin(), ints.end());
+			for (int i = 0; i < n; ++i)
+				floats[i] = ints[i] * 0.5f;
+			for (int e = -22; e <= 22; ++e)
 			{
-				bestCost = cost;
-				boxSize = size;
-				bestHypothesis = top;
+				if (countLessThan(ints.data(), ints.size(), e) != static_cast<size_t>(lower_bound(ints.begin(), ints.end(), e) - ints.begin()))
+					mismatches++;
+				const float f = e * 0.25f;
+				if (countLessThan(floats.data(), floats.size(), f) != static_cast<size_t>(lower_bound(floats.begin(), floats.end(), f) - floats.begin()))
+					mismatches++;
 			}
-			else if (fabs(cost - bestCost) <= costEpsilon) // prefer smaller stepSize
+		}
+		printf("Vectorized lower bound mismatches: %d\n", mismatches);
+		if (mismatches > 0)
+			return 1;
+	}
+
+	if(1)
+	{
+		// compile-time plane counts against the general search
+		mt19937 rng(21);
+		int mismatches = 0;
+		const int numTests = 300;
+		for (int t = 0; t < numTests; ++t)
+		{
+			const vector<float> stack = makeRandomStack(rng, 5, 0, 3, 15.f);
+			array<float, 5> depths;
+			copy(stack.begin(), stack.end(), depths.begin());
+			vector<int> hypothesis1;
+			array<int, 5> hypothesis2;
+			float size1 = 0.f, size2 = 0.f;
+			fitBoxSizeBnB(size1, hypothesis1, 100.f, 500.f, vector<float>(depths.begin(), depths.end()));
+			fitBoxSize<5>(size2, hypothesis2, 100.f, 500.f, depths);
+			if (size1 != size2 || hypothesis1 != vector<int>(hypothesis2.begin(), hypothesis2.end()))
+				mismatches++;
+
+			array<int, 3> hypothesis3;
+			const array<float, 3> depths3 = {{depths[0], depths[1], depths[2]}};
+			fitBoxSizeBnB(size1, hypothesis1, 100.f, 500.f, vector<float>(depths3.begin(), depths3.end()));
+			fitBoxSize<3>(size2, hypothesis3, 100.f, 500.f, depths3);
+			if (size1 != size2 || hypothesis1 != vector<int>(hypothesis3.begin(), hypothesis3.end()))
+				mismatches++;
+		}
+		printf("Fixed plane count mismatches: %d / %d\n", mismatches, 2 * numTests);
+		if (mismatches > 0)
+			return 1;
+	}
+
+	if(1)
+	{
+		// breakpoint sweep against branch and bound, including zero steps and wide size ranges
+		mt19937 rng(11);
+		uniform_int_distribution<int> planesDist(2, 8);
+		int mismatches = 0;
+		const int numTests = 20000;
+		for (int t = 0; t < numTests; ++t)
+		{
+			const vector<float> depths = makeRandomStack(rng, planesDist(rng), 0, 3, 20.f);
+			const float maxSize = t % 2 ? 500.f : 900.f;
+			vector<int> hypothesis1, hypothesis2;
+			float size1 = 0.f, size2 = 0.f;
+			fitBoxSizeBnB(size1, hypothesis1, 100.f, maxSize, depths);
+			fitBoxSizeSweep(size2, hypothesis2, 100.f, maxSize, depths);
+			if (size1 != size2 || hypothesis1 != hypothesis2)
+				mismatches++;
+		}
+		printf("Sweep mismatches: %d / %d\n", mismatches, numTests);
+		if (mismatches > 0)
+			return 1;
+	}
+
+	if(1)
+	{
+		// anytime search: same result as branch and bound without a budget, bounded on pathological stacks
+		mt19937 rng(17);
+		uniform_int_distribution<int> planesDist(2, 8);
+		int mismatches = 0;
+		const int numTests = 300;
+		for (int t = 0; t < numTests; ++t)
+		{
+			const vector<float> depths = makeRandomStack(rng, planesDist(rng), 0, 3, 20.f);
+			const float maxSize = t % 2 ? 500.f : 900.f;
+			vector<int> hypothesis1, hypothesis2;
+			float size1 = 0.f, size2 = 0.f;
+			fitBoxSizeBnB(size1, hypothesis1, 100.f, maxSize, depths);
+			const AnytimeFitStatus status = fitBoxSizeAnytime(size2, hypothesis2, 100.f, maxSize, depths, 0);
+			if (!status.optimal || size1 != size2 || hypothesis1 != hypothesis2)
+				mismatches++;
+		}
+		printf("Anytime mismatches: %d / %d\n", mismatches, numTests);
+		if (mismatches > 0)
+			return 1;
+
+		// tiny minimum size against a large span: the full search does not end
+		uniform_real_distribution<float> noiseDist(-20.f, 20.f);
+		vector<float> depths;
+		for (int p = 0; p < 14; ++p)
+			depths.push_back(1000.f + p * 310.f + noiseDist(rng));
+		vector<int> hypothesis;
+		float boxSize = 0.f;
+		const auto start = chrono::steady_clock::now();
+		const AnytimeFitStatus timed = fitBoxSizeAnytime(boxSize, hypothesis, 5.f, 500.f, depths, 0, 20.);
+		const double elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		const AnytimeFitStatus counted = fitBoxSizeAnytime(boxSize, hypothesis, 5.f, 500.f, depths, 100000);
+		printf("Anytime 14 planes: %.1f ms for a 20 ms budget (%s, %zu visited), node budget %zu visited, box size %.1f\n",
+			elapsedMs, timed.optimal ? "optimal" : "truncated", timed.numVisited, counted.numVisited, boxSize);
+		// the elapsed time is only reported, a loaded machine can overrun the budget by any amount
+		if (timed.optimal || counted.optimal || counted.numVisited > 100000 || hypothesis.size() != depths.size())
+			return 1;
+	}
+
+	if(1)
+	{
+		// tracker: same result as fitBoxSize on slowly moving stacks, kept results for unchanged depths
+		mt19937 rng(23);
+		uniform_real_distribution<float> jitterDist(-2.f, 2.f);
+		const int numStacks = 6;
+		const int numFrames = 40;
+		vector<vector<float> > stacks(numStacks);
+		for (int s = 0; s < numStacks; ++s)
+			stacks[s] = makeRandomStack(rng, 6 + s % 3, 1, 3, 0.f);
+
+		BoxSizeTracker tracker(0.5f);
+		int mismatches = 0;
+		size_t visitedCold = 0, visitedWarm = 0;
+		for (int f = 0; f < numFrames; ++f)
+		{
+			for (int s = 0; s < numStacks; ++s)
 			{
-				bool isMultiple = true;
-				for (size_t i = 1; i < top.size(); ++i)
+				// every other frame repeats the previous depths
+				vector<float> depths = stacks[s];
+				if (f % 2 == 0)
 				{
-					if (top[i] == 0)
-						continue;
-					if (bestHypothesis[i] % top[i] != 0.f)
-					{
-						isMultiple = false;
-						break;
-					}
+					for (size_t p = 0; p < depths.size(); ++p)
+						depths[p] += jitterDist(rng);
+					stacks[s] = depths;
 				}
-				if (isMultiple)
+				vector<int> hypothesis1, hypothesis2;
+				float size1 = 0.f, size2 = 0.f;
+				fitBoxSize(size1, hypothesis1, 100.f, 500.f, depths);
+				visitedCold += lastFitVisitedHypotheses();
+				const size_t missesBefore = tracker.numMisses();
+				tracker.fit(size2, hypothesis2, s, 100.f, 500.f, depths);
+				if (tracker.numMisses() != missesBefore)
+					visitedWarm += lastFitVisitedHypotheses();
+				if (size1 != size2 || hypothesis1 != hypothesis2)
+					mismatches++;
+			}
+		}
+		printf("Tracker mismatches: %d / %d, %zu hits, %zu misses (%zu warm), %zu visited vs %zu\n", mismatches, numFrames * numStacks,
+			tracker.numHits(), tracker.numMisses(), tracker.numWarmStarts(), visitedWarm, visitedCold);
+		if (mismatches > 0 || tracker.numHits() != numStacks * numFrames / 2 || tracker.numWarmStarts() == 0)
+			return 1;
+	}
+
+	if(1)
+	{
+		// batched sibling costs against the closed form in double, within the slack the search allows
+		mt19937 rng(29);
+		uniform_real_distribution<float> depthDist(0.f, 4000.f);
+		uniform_int_distribution<int> stepDist(0, 40);
+		uniform_int_distribution<int> countDist(1, 37);
+		int mismatches = 0;
+		const int numTests = 200;
+		for (int t = 0; t < numTests; ++t)
+		{
+			vector<float> depths(6);
+			for (size_t p = 0; p < depths.size(); ++p)
+				depths[p] = depthDist(rng);
+			sort(depths.begin(), depths.end());
+			float A = 0.f, B = 0.f;
+			double C = 0.;
+			int step = 0;
+			for (size_t p = 1; p + 1 < depths.size(); ++p)
+			{
+				step += stepDist(rng) / 8;
+				A += step * depths[p];
+				B += step * step;
+				C += static_cast<double>(depths[p]) * depths[p];
+			}
+			const float depth = depths.back();
+			C += static_cast<double>(depth) * depth;
+			const int count = countDist(rng);
+			const int firstStep = step + count - 1;
+			vector<float> costs(count);
+			lastStepCosts(costs.data(), count, firstStep, A, B, depth, static_cast<float>(C), 100.f, 500.f);
+			for (int k = 0; k < count; ++k)
+			{
+				const int s = firstStep - k;
+				const float a = A + s * depth;
+				const float b = B + s * s;
+				if (b <= 0.f)
 				{
-					bestCost = cost;
-					boxSize = size;
-					bestHypothesis = top;
+					mismatches += costs[k] != FLT_MAX;
+					continue;
 				}
+				const double size = max(min(a / b, 500.f), 100.f);
+				const double cost = C - 2. * size * a + size * size * b;
+				mismatches += fabs(costs[k] - cost) > 1e-5 * C;
 			}
 		}
-		else // add all possible hypothesis continuations
+		printf("Sibling cost mismatches: %d\n", mismatches);
+		if (mismatches > 0)
+			return 1;
+	}
+
+	if(1)
+	{
+		// plane depths of a synthetic 640x480 depth map, then the fit on the planes of a ROI
+		mt19937 rng(31);
+		uniform_int_distribution<int> noiseDist(-3, 3);
+		uniform_int_distribution<int> holeDist(0, 19);
+		const int width = 640, height = 480;
+		const float truth[] = {1200.f, 1450.f, 1950.f, 2200.f};
+		vector<uint16_t> image(width * height);
+		for (int y = 0; y < height; ++y)
 		{
-			for (int i = top.back() + minStep; i <= top.back() + maxStep; ++i)
+			for (int x = 0; x < width; ++x)
 			{
-				vector<int> h = top;
-				h.push_back(i);
-				remaining.push(h);
+				const float depth = truth[min(3, x / (width / 4))];
+				image[y * width + x] = holeDist(rng) == 0 ? 0 : static_cast<uint16_t>(depth + noiseDist(rng));
 			}
 		}
+
+		const DepthRoi roi = {&image[40 * width + 8], width * sizeof(uint16_t), 624, 400};
+		PlaneDetectionParams params;
+		params.minSeparation = 100.f;
+		vector<int> hypothesis1, hypothesis2;
+		float size1 = 0.f, size2 = 0.f;
+		fitBoxSizeFromDepth(size1, hypothesis1, 200.f, 300.f, roi, params);
+		const vector<float>& depths = lastPlaneDepths();
+		fitBoxSize(size2, hypothesis2, 200.f, 300.f, vector<float>(truth, truth + 4));
+		int mismatches = depths.size() != 4 || hypothesis1 != hypothesis2 || fabs(size1 - size2) > 1.f;
+		for (size_t p = 0; p < depths.size() && p < 4; ++p)
+			mismatches += fabs(depths[p] - truth[p]) > 1.f;
+
+		// histogram against a per-pixel count
+		vector<uint32_t> histogram, expected((params.maxDepth - params.minDepth + 3) / 4, 0);
+		depthHistogram(histogram, roi, params);
+		for (int y = 0; y < roi.height; ++y)
+		{
+			for (int x = 0; x < roi.width; ++x)
+			{
+				const uint16_t depth = roi.data[y * width + x];
+				if (depth >= params.minDepth && depth < params.maxDepth)
+					expected[(depth - params.minDepth) / 4]++;
+			}
+		}
+		mismatches += histogram != expected;
+
+		const int numRuns = 100;
+		const auto start = chrono::steady_clock::now();
+		for (int r = 0; r < numRuns; ++r)
+			fitBoxSizeFromDepth(size1, hypothesis1, 200.f, 300.f, roi, params);
+		const double elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / numRuns;
+		printf("Depth planes mismatches: %d, %zu planes, box size %.1f, %.3f ms per ROI\n", mismatches, depths.size(), size1, elapsedMs);
+		if (mismatches > 0)
+			return 1;
 	}
-}
 
-int main(int argc, char* argv[])
-{
-	if(0)
+	if(1)
 	{
-		vector<float> depths = {1083, 1415, 1745, 2079};
-		float boxDepth = 80;
-		printf("%.3f\n", getClosestElement(depths, boxDepth));
+		// multiple box sizes: one size gives the single size fit, two sizes are told apart on mixed stacks
+		mt19937 rng(37);
+		uniform_real_distribution<float> noiseDist(-3.f, 3.f);
+		uniform_int_distribution<int> typeDist(0, 1);
+		uniform_int_distribution<int> countDist(1, 2);
+		uniform_int_distribution<int> planesDist(3, 7);
+		const float truth[2] = {180.f, 310.f};
+		vector<BoxSizeRange> single(1), mixed(2);
+		single[0].minSize = 150.f;
+		single[0].maxSize = 220.f;
+		mixed[0].minSize = 165.f;
+		mixed[0].maxSize = 195.f;
+		mixed[1].minSize = 290.f;
+		mixed[1].maxSize = 330.f;
+		int mismatches = 0;
+		size_t visitedSingle = 0, visitedMixed = 0;
+		const int numTests = 100;
+		for (int t = 0; t < numTests; ++t)
+		{
+			// same size stack
+			const int numPlanes = planesDist(rng);
+			vector<float> depths(1, 1000.f + noiseDist(rng));
+			int step = 0;
+			for (int p = 1; p < numPlanes; ++p)
+			{
+				step += countDist(rng);
+				depths.push_back(1000.f + step * truth[0] + noiseDist(rng));
+			}
+			vector<int> hypothesis;
+			float boxSize = 0.f;
+			fitBoxSize(boxSize, hypothesis, single[0].minSize, single[0].maxSize, depths);
+			MultiBoxFit fit;
+			fitBoxSizes(fit, single, depths);
+			visitedSingle += lastFitVisitedHypotheses();
+			int boxes = 0;
+			for (int p = 1; p < numPlanes; ++p)
+			{
+				boxes += fit.counts[p];
+				mismatches += boxes != hypothesis[p];
+			}
+			mismatches += fabs(fit.boxSizes[0] - boxSize) > 0.01f;
+
+			// mixed stack of one box per gap, each size in 2 gaps at least so that its size is determined
+			const int numMixed = numPlanes + 2;
+			vector<int> counts;
+			int numUses[2] = {0, 0};
+			while (numUses[0] < 2 || numUses[1] < 2)
+			{
+				counts.assign(2 * numMixed, 0);
+				numUses[0] = numUses[1] = 0;
+				for (int p = 1; p < numMixed; ++p)
+				{
+					const int type = typeDist(rng);
+					counts[2 * p + type] = 1;
+					numUses[type]++;
+				}
+			}
+			float depth = 1000.f;
+			depths.assign(1, depth + noiseDist(rng));
+			for (int p = 1; p < numMixed; ++p)
+			{
+				depth += counts[2 * p] * truth[0] + counts[2 * p + 1] * truth[1];
+				depths.push_back(depth + noiseDist(rng));
+			}
+			fitBoxSizes(fit, mixed, depths);
+			visitedMixed += lastFitVisitedHypotheses();
+			mismatches += fit.counts != counts;
+			for (int k = 0; k < 2; ++k)
+				mismatches += fabs(fit.boxSizes[k] - truth[k]) > 5.f;
+		}
+		printf("Multiple box size mismatches: %d / %d, %zu visited with 2 sizes vs %zu with 1\n", mismatches, numTests, visitedMixed, visitedSingle);
+		if (mismatches > 0)
+			return 1;
 	}
 
 	if(1)
 	{
-		vector<float> vec = {0.f, 10.f, 215.f, 800.f, 1100.f};
-		const float minSize = 200.f;
-		const float maxSize = 600.f;
-		vector<int> bestHypothesis;
-		float bestSize;
-		fitBoxSize(bestSize, bestHypothesis, minSize, maxSize, vec);
-		printf("Best fit1: %.1f\n", bestSize);
-		fitBoxSize2(bestSize, bestHypothesis, minSize, maxSize, vec);
-		printf("Best fit2: %.1f\n", bestSize);
+		// latest-wins queue: taken frames are newer and newer, and the last pushed one is never dropped
+		mt19937 rng(41);
+		uniform_int_distribution<int> burstDist(1, 4);
+		LatestFrameQueue<int> queue(1);
+		atomic<int> lastPushed(0), lastChecked(0);
+		atomic<bool> done(false);
+		int mismatches = 0;
+		const int numBursts = 20000;
+		thread consumer([&]()
+		{
+			int lastTaken = 0;
+			for (;;)
+			{
+				const int pushed = lastPushed.load();
+				const bool finished = done.load();
+				int frame = 0;
+				if (queue.popLatest(frame))
+				{
+					mismatches += frame <= lastTaken;
+					lastTaken = frame;
+				}
+				else if (pushed > lastChecked.load())
+				{
+					// the producer waits for this check, nothing newer than pushed can be dropped
+					mismatches += lastTaken != pushed;
+					mismatches += queue.numTaken() + queue.numDropped() != queue.numPushed();
+					lastChecked.store(pushed);
+				}
+				else if (finished)
+					break;
+				else
+					this_thread::yield();
+			}
+		});
+		int frame = 0;
+		for (int b = 0; b < numBursts; ++b)
+		{
+			const int numFrames = burstDist(rng);
+			for (int f = 0; f < numFrames; ++f)
+			{
+				int next = ++frame;
+				queue.push(move(next));
+				if (burstDist(rng) == 1)
+					this_thread::yield();
+			}
+			lastPushed.store(frame);
+			while (lastChecked.load() != frame)
+				this_thread::yield();
+		}
+		done.store(true);
+		consumer.join();
+		printf("Frame queue mismatches: %d / %d, %zu pushed, %zu taken, %zu dropped\n", mismatches, numBursts,
+			queue.numPushed(), queue.numTaken(), queue.numDropped());
+		if (mismatches > 0)
+			return 1;
+	}
+
+	if(1)
+	{
+		// vectorized linmath against its scalar code, also with the outputs aliasing the inputs
+		mt19937 rng(31);
+		uniform_real_distribution<float> valueDist(-1.f, 1.f);
+		int mismatches = 0;
+		const int numTests = 200;
+		for (int t = 0; t < numTests; ++t)
+		{
+			// diagonally dominant, so well conditioned for the inverse
+			mat4x4 a, b;
+			for (int c = 0; c < 4; ++c)
+			{
+				for (int r = 0; r < 4; ++r)
+				{
+					a[c][r] = valueDist(rng) + (c == r ? 4.f : 0.f);
+					b[c][r] = 100.f * valueDist(rng);
+				}
+			}
+			// bounds of the summed products: 4 terms of a (up to 5) times b (up to 100), of b times points (up to 100)
+			const float mulScale = 4.f * 5.f * 100.f;
+			const float pointScale = 4.f * 100.f * 100.f;
+			mat4x4 expected, M;
+			mat4x4_mul_reference(expected, a, b);
+			mat4x4_mul(M, a, b);
+			mismatches += !nearlyEqual(expected[0], M[0], 16, mulScale);
+			mat4x4_dup(M, a);
+			mat4x4_mul(M, M, b);
+			mismatches += !nearlyEqual(expected[0], M[0], 16, mulScale);
+			mat4x4_dup(M, b);
+			mat4x4_mul(M, a, M);
+			mismatches += !nearlyEqual(expected[0], M[0], 16, mulScale);
+			mat4x4_mul_reference(expected, a, a);
+			mat4x4_dup(M, a);
+			mat4x4_mul(M, M, M);
+			mismatches += !nearlyEqual(expected[0], M[0], 16, mulScale);
+
+			mat4x4_invert_reference(expected, a);
+			mat4x4_invert(M, a);
+			mismatches += !nearlyEqual(expected[0], M[0], 16, 10.f);
+			mat4x4_dup(M, a);
+			mat4x4_invert(M, M);
+			mismatches += !nearlyEqual(expected[0], M[0], 16, 10.f);
+
+			quat p, q, expectedQ, r;
+			for (int i = 0; i < 4; ++i)
+			{
+				p[i] = valueDist(rng);
+				q[i] = valueDist(rng);
+			}
+			quat_mul_reference(expectedQ, p, q);
+			quat_mul(r, p, q);
+			mismatches += !nearlyEqual(expectedQ, r, 4, 4.f);
+			copy(p, p + 4, r);
+			quat_mul(r, r, q);
+			mismatches += !nearlyEqual(expectedQ, r, 4, 4.f);
+			copy(q, q + 4, r);
+			quat_mul(r, p, r);
+			mismatches += !nearlyEqual(expectedQ, r, 4, 4.f);
+
+			// 0 to 19 points, over the SSE and AVX2 widths and their scalar tails, w = 1 for the affine transforms
+			const size_t n = t % 20;
+			vector<float> points(4 * n), expectedPoints(4 * n);
+			for (size_t i = 0; i < n; ++i)
+			{
+				for (int k = 0; k < 3; ++k)
+					points[4 * i + k] = 100.f * valueDist(rng);
+				points[4 * i + 3] = 1.f;
+				mat4x4_mul_vec4_reference(&expectedPoints[4 * i], b, &points[4 * i]);
+			}
+			vector<float> batch(4 * n);
+			mat4x4_mul_vec4_batch(reinterpret_cast<vec4*>(batch.data()), b, reinterpret_cast<const vec4*>(points.data()), n);
+			mismatches += !nearlyEqual(expectedPoints.data(), batch.data(), batch.size(), pointScale);
+			batch = points;
+			mat4x4_mul_vec4_batch(reinterpret_cast<vec4*>(batch.data()), b, reinterpret_cast<const vec4*>(batch.data()), n);
+			mismatches += !nearlyEqual(expectedPoints.data(), batch.data(), batch.size(), pointScale);
+
+			vector<float> soa(3 * n), expectedSoa(3 * n), transformed(3 * n);
+			for (size_t i = 0; i < n; ++i)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					soa[k * n + i] = points[4 * i + k];
+					expectedSoa[k * n + i] = expectedPoints[4 * i + k];
+				}
+			}
+			float* x = soa.data();
+			float* rx = transformed.data();
+			mat4x4_transform_soa(rx, rx + n, rx + 2 * n, b, x, x + n, x + 2 * n, n);
+			mismatches += !nearlyEqual(expectedSoa.data(), transformed.data(), transformed.size(), pointScale);
+			mat4x4_transform_soa(x, x + n, x + 2 * n, b, x, x + n, x + 2 * n, n);
+			mismatches += !nearlyEqual(expectedSoa.data(), soa.data(), soa.size(), pointScale);
+
+			const size_t numBlocks = n / LINMATH_BLOCK;
+			vector<float> aosoa(3 * LINMATH_BLOCK * numBlocks), expectedAosoa(aosoa.size()), transformedBlocks(aosoa.size());
+			for (size_t i = 0; i < numBlocks * LINMATH_BLOCK; ++i)
+			{
+				const size_t first = 3 * LINMATH_BLOCK * (i / LINMATH_BLOCK) + i % LINMATH_BLOCK;
+				for (int k = 0; k < 3; ++k)
+				{
+					aosoa[first + k * LINMATH_BLOCK] = points[4 * i + k];
+					expectedAosoa[first + k * LINMATH_BLOCK] = expectedPoints[4 * i + k];
+				}
+			}
+			mat4x4_transform_aosoa(transformedBlocks.data(), b, aosoa.data(), numBlocks);
+			mismatches += !nearlyEqual(expectedAosoa.data(), transformedBlocks.data(), transformedBlocks.size(), pointScale);
+			mat4x4_transform_aosoa(aosoa.data(), b, aosoa.data(), numBlocks);
+			mismatches += !nearlyEqual(expectedAosoa.data(), aosoa.data(), aosoa.size(), pointScale);
+		}
+		printf("Linmath SIMD mismatches: %d / %d\n", mismatches, 15 * numTests);
+		if (mismatches > 0)
+			return 1;
 	}
 
   return 0;
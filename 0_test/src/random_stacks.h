@@ -0,0 +1,26 @@
+#ifndef RANDOM_STACKS_H
+#define RANDOM_STACKS_H
+
+#include <vector>
+#include <random>
+
+// Depths of numPlanes planes from 1000 mm, minStep to maxStep boxes of a random size in [minSize, maxSize] apart,
+// with uniform noise in [-noise, noise] on every plane. Shared by the tests and the benchmark.
+inline std::vector<float> makeRandomStack(std::mt19937& rng, const int numPlanes, const int minStep, const int maxStep,
+	const float noise, const float minSize = 150.f, const float maxSize = 450.f)
+{
+	std::uniform_real_distribution<float> sizeDist(minSize, maxSize);
+	std::uniform_real_distribution<float> noiseDist(-noise, noise);
+	std::uniform_int_distribution<int> stepDist(minStep, maxStep);
+	const float size = sizeDist(rng);
+	std::vector<float> depths(1, 1000.f + noiseDist(rng));
+	int step = 0;
+	for (int p = 1; p < numPlanes; ++p)
+	{
+		step += stepDist(rng);
+		depths.push_back(1000.f + step * size + noiseDist(rng));
+	}
+	return depths;
+}
+
+#endif // RANDOM_STACKS_H
@@ -0,0 +1,167 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads running index-parallel loops
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned numThreads = 0)
+	{
+		if (numThreads == 0)
+			numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		// the calling thread also runs tasks
+		for (unsigned i = 1; i < numThreads; ++i)
+			workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stop = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); ++i)
+			workers[i].join();
+	}
+
+	unsigned size() const
+	{
+		return static_cast<unsigned>(workers.size()) + 1;
+	}
+
+	// Run task(i) for each i in [0, count) and return when all are done.
+	// Indices are handed out one at a time, so uneven tasks balance across threads.
+	// One loop runs on the workers at a time: a call made from a task (of any pool) or while another thread's loop
+	// is running runs its tasks on the calling thread instead of waiting for the workers.
+	void parallelFor(const size_t count, const std::function<void(size_t)>& task)
+	{
+		if (workers.empty() || count < 2 || runningTask())
+		{
+			runInline(count, task);
+			return;
+		}
+		std::unique_lock<std::mutex> submitted(submitLock, std::try_to_lock);
+		if (!submitted.owns_lock())
+		{
+			runInline(count, task);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			currentTask = &task;
+			numTasks = count;
+			nextTask = 0;
+			numActive = static_cast<unsigned>(workers.size());
+			generation++;
+		}
+		wake.notify_all();
+		try
+		{
+			const TaskScope scope;
+			runTasks();
+		}
+		catch (...)
+		{
+			// the workers still reference the task
+			waitForWorkers();
+			throw;
+		}
+		waitForWorkers();
+	}
+
+private:
+	// Whether the calling thread is running a task of a pool
+	static bool& runningTask()
+	{
+		static thread_local bool running = false;
+		return running;
+	}
+
+	// Marks the calling thread as running tasks until the end of the scope, even if a task throws
+	class TaskScope
+	{
+	public:
+		TaskScope()
+			: previous(runningTask())
+		{
+			runningTask() = true;
+		}
+
+		~TaskScope()
+		{
+			runningTask() = previous;
+		}
+
+		TaskScope(const TaskScope&) = delete;
+		TaskScope& operator=(const TaskScope&) = delete;
+
+	private:
+		const bool previous;
+	};
+
+	static void runInline(const size_t count, const std::function<void(size_t)>& task)
+	{
+		for (size_t i = 0; i < count; ++i)
+			task(i);
+	}
+
+	void runTasks()
+	{
+		for (size_t i = nextTask++; i < numTasks; i = nextTask++)
+			(*currentTask)(i);
+	}
+
+	void waitForWorkers()
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		done.wait(guard, [this] { return numActive == 0; });
+		currentTask = nullptr;
+	}
+
+	void workerLoop()
+	{
+		size_t seen = 0;
+		const TaskScope scope;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				wake.wait(guard, [&] { return stop || generation != seen; });
+				if (stop)
+					return;
+				seen = generation;
+			}
+			runTasks();
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (--numActive == 0)
+					done.notify_one();
+			}
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex submitLock; // held by the thread whose loop runs on the workers
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(size_t)>* currentTask = nullptr;
+	size_t numTasks = 0;
+	std::atomic<size_t> nextTask;
+	size_t generation = 0;
+	unsigned numActive = 0;
+	bool stop = false;
+};
+
+#endif // THREAD_POOL_H
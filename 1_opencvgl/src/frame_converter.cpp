@@ -0,0 +1,224 @@
+#include "frame_converter.h"
+
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+static const char* converterVertexShader = ""
+"attribute vec3 pos;\n"
+"attribute vec2 uv;\n"
+"varying vec2 tex_uv;\n"
+"\n"
+"void main()\n"
+"{\n"
+"	gl_Position = vec4(pos, 1);\n"
+"	tex_uv = uv;\n"
+"}\n";
+
+// One source for all layouts, the variant is selected by the define prepended to it
+static const char* converterFragmentShader = ""
+"uniform sampler2D tex;\n"
+"uniform sampler2D chroma;\n"
+"uniform vec2 range;\n"
+"uniform int colormap;\n"
+"uniform float width;\n"
+"varying vec2 tex_uv;\n"
+"\n"
+"// BT.601, video range\n"
+"vec3 yuvToRgb(float y, float u, float v)\n"
+"{\n"
+"	y = 1.1644 * (y - 0.0625);\n"
+"	u -= 0.5;\n"
+"	v -= 0.5;\n"
+"	return clamp(vec3(y + 1.5960 * v, y - 0.3918 * u - 0.8130 * v, y + 2.0172 * u), 0.0, 1.0);\n"
+"}\n"
+"\n"
+"vec3 jet(float t)\n"
+"{\n"
+"	return clamp(vec3(1.5) - abs(4.0 * t - vec3(3.0, 2.0, 1.0)), 0.0, 1.0);\n"
+"}\n"
+"\n"
+"// polynomial fit of the Turbo colormap\n"
+"vec3 turbo(float t)\n"
+"{\n"
+"	vec4 v4 = vec4(1.0, t, t * t, t * t * t);\n"
+"	vec2 v2 = v4.zw * v4.z;\n"
+"	return clamp(vec3(\n"
+"		dot(v4, vec4(0.13572138, 4.61539260, -42.66032258, 132.13108234)) + dot(v2, vec2(-152.94239396, 59.28637943)),\n"
+"		dot(v4, vec4(0.09140261, 2.19418839, 4.84296658, -14.18503333)) + dot(v2, vec2(4.27729857, 2.82956604)),\n"
+"		dot(v4, vec4(0.10667330, 12.64194608, -60.58204836, 110.36276771)) + dot(v2, vec2(-89.90310912, 27.34824973))),\n"
+"		0.0, 1.0);\n"
+"}\n"
+"\n"
+"vec3 valueToRgb(float value)\n"
+"{\n"
+"	float t = clamp((value - range.x) / (range.y - range.x), 0.0, 1.0);\n"
+"	if (colormap == 1)\n"
+"		return jet(t);\n"
+"	if (colormap == 2)\n"
+"		return turbo(t);\n"
+"	return vec3(t);\n"
+"}\n"
+"\n"
+"void main()\n"
+"{\n"
+"	vec3 rgb;\n"
+"#if defined(FRAME_NV12)\n"
+"	vec2 uv = texture2D(chroma, tex_uv).rg;\n"
+"	rgb = yuvToRgb(texture2D(tex, tex_uv).r, uv.r, uv.g);\n"
+"#elif defined(FRAME_YUYV)\n"
+"	// a texel holds Y0 U Y1 V, the luma depends on the column parity\n"
+"	vec4 pair = texture2D(tex, tex_uv);\n"
+"	float odd = mod(floor(tex_uv.x * width), 2.0);\n"
+"	rgb = yuvToRgb(mix(pair.r, pair.b, odd), pair.g, pair.a);\n"
+"#elif defined(FRAME_DEPTH16) || defined(FRAME_FLOAT32)\n"
+"	float value = texture2D(tex, tex_uv).r;\n"
+"#if defined(FRAME_DEPTH16)\n"
+"	value *= 65535.0;\n"
+"	bool valid = value > 0.0;\n"
+"#else\n"
+"	bool valid = value == value;\n"
+"#endif\n"
+"	rgb = valid ? valueToRgb(value) : vec3(0.0);\n"
+"#else\n"
+"	rgb = texture2D(tex, tex_uv).rgb;\n"
+"#endif\n"
+"	gl_FragColor = vec4(rgb, 1.0);\n"
+"}\n";
+
+FrameConverter::FrameConverter()
+	: frameLayout(FRAME_BGR8), frameHeight(0), numPlanes(0), rangeLocation(-1), colormapLocation(-1),
+	rangeMin(0.f), rangeMax(1.f), currentColormap(COLORMAP_TURBO)
+{
+}
+
+bool FrameConverter::init(FrameLayout layout, int width, int height)
+{
+	release();
+	if (layout != FRAME_BGR8 && !glVersionAtLeast(3, 0) && !glHasExtension("GL_ARB_texture_rg"))
+	{
+		printf("Raw frame formats need OpenGL 3.0\n");
+		return false;
+	}
+	frameLayout = layout;
+	frameHeight = height;
+
+	// textures holding the raw samples, the shader does the conversion
+	bool created;
+	string define;
+	GLint filter = GL_LINEAR;
+	switch (layout)
+	{
+	case FRAME_NV12:
+		created = planes[0].init(width, height, GL_R8, GL_RED, GL_UNSIGNED_BYTE) &&
+			planes[1].init(width / 2, height / 2, GL_RG8, GL_RG, GL_UNSIGNED_BYTE);
+		numPlanes = 2;
+		define = "FRAME_NV12";
+		break;
+	case FRAME_YUYV:
+		created = planes[0].init(width / 2, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+		numPlanes = 1;
+		define = "FRAME_YUYV";
+		filter = GL_NEAREST; // interpolating between pairs mixes their luma
+		break;
+	case FRAME_DEPTH16:
+		created = planes[0].init(width, height, GL_R16, GL_RED, GL_UNSIGNED_SHORT);
+		numPlanes = 1;
+		define = "FRAME_DEPTH16";
+		filter = GL_NEAREST; // no interpolation with invalid values
+		rangeMin = 0.f;
+		rangeMax = 5000.f;
+		break;
+	case FRAME_FLOAT32:
+		created = planes[0].init(width, height, GL_R32F, GL_RED, GL_FLOAT);
+		numPlanes = 1;
+		define = "FRAME_FLOAT32";
+		filter = GL_NEAREST;
+		rangeMin = 0.f;
+		rangeMax = 1.f;
+		break;
+	default:
+		created = planes[0].init(width, height, GL_RGB8, GL_BGR, GL_UNSIGNED_BYTE);
+		numPlanes = 1;
+		define = "FRAME_BGR8";
+		break;
+	}
+	if (!created)
+	{
+		release();
+		return false;
+	}
+	for (int i = 0; i < numPlanes; ++i)
+	{
+		glBindTexture(GL_TEXTURE_2D, planes[i].texture());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	const string fragmentSource = "#define " + define + "\n" + converterFragmentShader;
+	if (!renderer.init(converterVertexShader, fragmentSource.c_str()))
+	{
+		release();
+		return false;
+	}
+	const GLuint program = renderer.program();
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "chroma"), 1);
+	glUniform1f(glGetUniformLocation(program, "width"), static_cast<float>(width));
+	rangeLocation = glGetUniformLocation(program, "range");
+	colormapLocation = glGetUniformLocation(program, "colormap");
+	glUniform2f(rangeLocation, rangeMin, rangeMax);
+	glUniform1i(colormapLocation, currentColormap);
+	glUseProgram(0);
+	return glGetError() == GL_NO_ERROR;
+}
+
+void FrameConverter::release()
+{
+	renderer.release();
+	for (int i = 0; i < 2; ++i)
+		planes[i].release();
+	numPlanes = 0;
+}
+
+bool FrameConverter::upload(const void* data, size_t step)
+{
+	if (numPlanes == 0 || !planes[0].upload(data, step))
+		return false;
+	if (frameLayout == FRAME_NV12)
+		return planes[1].upload(static_cast<const unsigned char*>(data) + step * frameHeight, step);
+	return true;
+}
+
+void FrameConverter::setRange(float minValue, float maxValue)
+{
+	rangeMin = minValue;
+	rangeMax = maxValue;
+	glUseProgram(renderer.program());
+	glUniform2f(rangeLocation, rangeMin, rangeMax);
+	glUseProgram(0);
+}
+
+void FrameConverter::setColormap(Colormap colormap)
+{
+	currentColormap = colormap;
+	glUseProgram(renderer.program());
+	glUniform1i(colormapLocation, currentColormap);
+	glUseProgram(0);
+}
+
+void FrameConverter::draw()
+{
+	const GLuint textures[2] = { planes[0].texture(), planes[1].texture() };
+	renderer.draw(textures, numPlanes);
+}
+
+double FrameConverter::lastUploadMs() const
+{
+	double total = 0.;
+	for (int i = 0; i < numPlanes; ++i)
+		total += planes[i].lastUploadMs();
+	return total;
+}
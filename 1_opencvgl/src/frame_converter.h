@@ -0,0 +1,67 @@
+#ifndef FRAME_CONVERTER_H
+#define FRAME_CONVERTER_H
+
+#include "glutils.h"
+#include "texture_stream.h"
+#include "quad_renderer.h"
+
+// Memory layout of a raw camera frame, as the cv::Mat holding it
+enum FrameLayout
+{
+	FRAME_BGR8,    // CV_8UC3
+	FRAME_NV12,    // CV_8UC1 of height * 3 / 2 rows: Y plane, then interleaved U and V at half resolution
+	FRAME_YUYV,    // CV_8UC2: Y0 U Y1 V for each pair of pixels
+	FRAME_DEPTH16, // CV_16UC1, 0 is invalid
+	FRAME_FLOAT32  // CV_32FC1, NaN is invalid
+};
+
+// Colors of the depth and float values between the range bounds
+enum Colormap
+{
+	COLORMAP_GRAY,
+	COLORMAP_JET,
+	COLORMAP_TURBO
+};
+
+// Draws raw camera frames over the viewport, converting them in the fragment shader: YUV to RGB (BT.601 video
+// range) or depth and float values through a colormap. The CPU only copies the frame into the textures.
+class FrameConverter
+{
+public:
+	FrameConverter();
+
+	FrameConverter(const FrameConverter&) = delete;
+	FrameConverter& operator=(const FrameConverter&) = delete;
+
+	// Textures and shader variant for frames of width x height pixels. Needs OpenGL 3.0 except for FRAME_BGR8.
+	bool init(FrameLayout layout, int width, int height);
+
+	void release();
+
+	// Copy a raw frame with rows of step bytes (for NV12 the chroma rows follow the luma rows with the same step)
+	bool upload(const void* data, size_t step);
+
+	// Raw values mapped to the ends of the colormap, e.g. millimetres for depth
+	void setRange(float minValue, float maxValue);
+
+	void setColormap(Colormap colormap);
+
+	void draw();
+
+	// CPU time of the last upload, in milliseconds
+	double lastUploadMs() const;
+
+private:
+	FrameLayout frameLayout;
+	int frameHeight;
+	TextureStream planes[2];
+	int numPlanes;
+	QuadRenderer renderer;
+	GLint rangeLocation;
+	GLint colormapLocation;
+	float rangeMin;
+	float rangeMax;
+	Colormap currentColormap;
+};
+
+#endif // FRAME_CONVERTER_H
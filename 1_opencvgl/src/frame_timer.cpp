@@ -0,0 +1,171 @@
+#include "frame_timer.h"
+
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+FrameTimer::FrameTimer()
+	: numStages(0), numSlots(0), currentSlot(0), currentStage(-1), frameStarted(false), skipped(0)
+{
+}
+
+bool FrameTimer::init(const vector<string>& stageNames, int numFramesInFlight)
+{
+	release();
+	names = stageNames;
+	numStages = static_cast<int>(names.size());
+	numSlots = max(1, numFramesInFlight);
+	cpuMs.assign(numStages + 1, vector<double>());
+	gpuMs.assign(numStages + 1, vector<double>());
+	currentSlot = 0;
+	currentStage = -1;
+	frameStarted = false;
+	skipped = 0;
+
+	if (glVersionAtLeast(3, 3) || glHasExtension("GL_ARB_timer_query"))
+	{
+		queries.resize(numStages * numSlots);
+		glGenQueries(static_cast<GLsizei>(queries.size()), &queries[0]);
+		issued.assign(queries.size(), false);
+	}
+	else
+		printf("No timer queries, measuring the CPU only\n");
+	return glGetError() == GL_NO_ERROR;
+}
+
+void FrameTimer::release()
+{
+	if (!queries.empty())
+		glDeleteQueries(static_cast<GLsizei>(queries.size()), &queries[0]);
+	queries.clear();
+	issued.clear();
+	currentStage = -1;
+}
+
+void FrameTimer::beginFrame()
+{
+	if (numStages == 0)
+		return;
+	const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if (frameStarted)
+		cpuMs[numStages].push_back(chrono::duration<double, milli>(now - frameStart).count());
+	frameStart = now;
+	frameStarted = true;
+	currentStage = -1;
+}
+
+void FrameTimer::beginStage(int stage)
+{
+	if (stage < 0 || stage >= numStages)
+		return;
+	const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if (currentStage >= 0)
+	{
+		cpuMs[currentStage].push_back(chrono::duration<double, milli>(now - stageStart).count());
+		if (!queries.empty())
+			glEndQuery(GL_TIME_ELAPSED);
+	}
+	currentStage = stage;
+	stageStart = now;
+
+	// only one time elapsed query can be active, the stages follow each other
+	if (!queries.empty())
+	{
+		const int index = currentSlot * numStages + stage;
+		glBeginQuery(GL_TIME_ELAPSED, queries[index]);
+		issued[index] = true;
+	}
+}
+
+void FrameTimer::endFrame()
+{
+	if (numStages == 0)
+		return;
+	if (currentStage >= 0)
+	{
+		cpuMs[currentStage].push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - stageStart).count());
+		if (!queries.empty())
+			glEndQuery(GL_TIME_ELAPSED);
+	}
+	currentStage = -1;
+
+	// the next slot is reused by the next frame, its queries were issued numSlots - 1 frames ago
+	currentSlot = (currentSlot + 1) % numSlots;
+	if (!queries.empty())
+		collect(currentSlot);
+}
+
+void FrameTimer::collect(int slot)
+{
+	double frameMs = 0.;
+	bool complete = true;
+	bool any = false;
+	for (int stage = 0; stage < numStages; ++stage)
+	{
+		const int index = slot * numStages + stage;
+		if (!issued[index])
+			continue;
+		issued[index] = false;
+		GLint available = 0;
+		glGetQueryObjectiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			// reading the result now would wait for the GPU
+			skipped++;
+			complete = false;
+			continue;
+		}
+		GLuint64 elapsedNs = 0;
+		glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &elapsedNs);
+		const double ms = elapsedNs * 1e-6;
+		gpuMs[stage].push_back(ms);
+		frameMs += ms;
+		any = true;
+	}
+	if (any && complete)
+		gpuMs[numStages].push_back(frameMs);
+}
+
+double FrameTimer::percentile(int stage, bool gpu, double p) const
+{
+	const int series = stage < 0 || stage >= numStages ? numStages : stage;
+	if (series >= static_cast<int>(cpuMs.size()))
+		return 0.;
+	vector<double> samples = gpu ? gpuMs[series] : cpuMs[series];
+	if (samples.empty())
+		return 0.;
+	const size_t rank = static_cast<size_t>(floor(min(max(p, 0.), 100.) / 100. * (samples.size() - 1) + 0.5));
+	nth_element(samples.begin(), samples.begin() + rank, samples.end());
+	return samples[rank];
+}
+
+bool FrameTimer::writeCsv(const char* path) const
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return false;
+	fprintf(file, "stage,cpu_samples,cpu_p50_ms,cpu_p99_ms,gpu_samples,gpu_p50_ms,gpu_p99_ms\n");
+	for (int stage = 0; stage <= numStages; ++stage)
+	{
+		const int index = stage < numStages ? stage : -1;
+		fprintf(file, "%s,%zu,%.4f,%.4f,%zu,%.4f,%.4f\n", stage < numStages ? names[stage].c_str() : "frame",
+			cpuMs[stage].size(), percentile(index, false, 50.), percentile(index, false, 99.),
+			gpuMs[stage].size(), percentile(index, true, 50.), percentile(index, true, 99.));
+	}
+	return fclose(file) == 0;
+}
+
+void FrameTimer::printSummary() const
+{
+	printf("%-10s %12s %12s %12s %12s\n", "Stage", "CPU p50 ms", "CPU p99 ms", "GPU p50 ms", "GPU p99 ms");
+	for (int stage = 0; stage <= numStages; ++stage)
+	{
+		const int index = stage < numStages ? stage : -1;
+		printf("%-10s %12.3f %12.3f %12.3f %12.3f\n", stage < numStages ? names[stage].c_str() : "frame",
+			percentile(index, false, 50.), percentile(index, false, 99.), percentile(index, true, 50.), percentile(index, true, 99.));
+	}
+	if (skipped > 0)
+		printf("GPU results not available in time: %zu\n", skipped);
+}
@@ -0,0 +1,75 @@
+#ifndef FRAME_TIMER_H
+#define FRAME_TIMER_H
+
+#include "glutils.h"
+#include <vector>
+#include <string>
+#include <chrono>
+
+// Time spent in each stage of the render loop (e.g. prepare, upload, draw, swap), on the CPU with a steady clock and
+// on the GPU with GL_TIME_ELAPSED queries. The queries of numFramesInFlight frames are kept in a pool and a frame's
+// results are only read before its slot is reused, when the GPU has finished them, so collecting never stalls the
+// loop; a result still not available then is skipped. Stages do not nest: beginning a stage ends the previous one,
+// and each stage runs at most once per frame. Without init the calls do nothing.
+class FrameTimer
+{
+public:
+	FrameTimer();
+
+	FrameTimer(const FrameTimer&) = delete;
+	FrameTimer& operator=(const FrameTimer&) = delete;
+
+	// Stages named for the reports. The GPU queries need OpenGL 3.3 or ARB_timer_query, without them only the CPU
+	// times are measured. Needs a current context.
+	bool init(const std::vector<std::string>& stageNames, int numFramesInFlight = 2);
+
+	// Delete the queries. Needs the context of init to be current.
+	void release();
+
+	void beginFrame();
+
+	void beginStage(int stage);
+
+	// End the last stage and collect the GPU times of the oldest frame of the pool
+	void endFrame();
+
+	// Percentile p (0 to 100) of the times of a stage, in milliseconds. Stage -1 is the whole frame, from one
+	// beginFrame to the next on the CPU and summed over the stages on the GPU. Returns 0 without samples.
+	double percentile(int stage, bool gpu, double p) const;
+
+	// One row per stage and one for the frame: samples, p50 and p99 on the CPU and the GPU
+	bool writeCsv(const char* path) const;
+
+	void printSummary() const;
+
+	bool gpuTimers() const
+	{
+		return !queries.empty();
+	}
+
+	// GPU results skipped because they were not available in time
+	size_t numSkipped() const
+	{
+		return skipped;
+	}
+
+private:
+	// Collect the results of a slot of the query pool
+	void collect(int slot);
+
+	std::vector<std::string> names;
+	int numStages;
+	int numSlots;
+	std::vector<GLuint> queries; // numStages per slot
+	std::vector<bool> issued;    // query written in its slot and not collected yet
+	int currentSlot;
+	int currentStage;
+	bool frameStarted;
+	std::chrono::steady_clock::time_point frameStart;
+	std::chrono::steady_clock::time_point stageStart;
+	std::vector<std::vector<double> > cpuMs; // numStages + 1 series, the last for the frame
+	std::vector<std::vector<double> > gpuMs;
+	size_t skipped;
+};
+
+#endif // FRAME_TIMER_H
@@ -0,0 +1,109 @@
+#include "glutils.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+bool glVersionAtLeast(int major, int minor)
+{
+	// "major.minor[.release] [vendor info]", also for compatibility and ES contexts
+	const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+	if (!version)
+		return false;
+	while (*version && (*version < '0' || *version > '9'))
+		version++;
+	int contextMajor = 0, contextMinor = 0;
+	if (sscanf(version, "%d.%d", &contextMajor, &contextMinor) != 2)
+		return false;
+	return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+bool glHasExtension(const char* name)
+{
+	// the extension string is not available in core profiles, list them one by one
+	if (glVersionAtLeast(3, 0))
+	{
+		GLint numExtensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+		for (GLint i = 0; i < numExtensions; ++i)
+		{
+			const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+			if (extension && strcmp(extension, name) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+	const size_t length = strlen(name);
+	for (const char* p = extensions; p && (p = strstr(p, name)) != NULL; p += length)
+	{
+		// whole words only
+		if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+			return true;
+	}
+	return false;
+}
+
+#ifdef GL_VERSION_4_3
+static void APIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+	const GLchar* message, const void* userParam)
+{
+	printf("%s: %s\n", type == GL_DEBUG_TYPE_ERROR ? "ErrorGL" : "WarningGL", message);
+}
+#endif
+
+bool glEnableDebugOutput()
+{
+#ifdef GL_VERSION_4_3
+	if (!glVersionAtLeast(4, 3) && !glHasExtension("GL_KHR_debug"))
+		return false;
+	glEnable(GL_DEBUG_OUTPUT);
+	// report in the failing call, so a breakpoint in the callback shows it
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(debugMessage, NULL);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE);
+	return true;
+#else
+	return false;
+#endif
+}
+
+size_t glPixelSize(GLenum format, GLenum type)
+{
+	size_t channels = 4;
+	switch (format)
+	{
+	case GL_RED:
+	case GL_RED_INTEGER:
+	case GL_DEPTH_COMPONENT:
+		channels = 1;
+		break;
+	case GL_RG:
+	case GL_RG_INTEGER:
+		channels = 2;
+		break;
+	case GL_RGB:
+	case GL_BGR:
+	case GL_RGB_INTEGER:
+		channels = 3;
+		break;
+	}
+
+	size_t depth = 1;
+	switch (type)
+	{
+	case GL_UNSIGNED_SHORT:
+	case GL_SHORT:
+	case GL_HALF_FLOAT:
+		depth = 2;
+		break;
+	case GL_UNSIGNED_INT:
+	case GL_INT:
+	case GL_FLOAT:
+		depth = 4;
+		break;
+	}
+	return channels * depth;
+}
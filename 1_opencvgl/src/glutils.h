@@ -0,0 +1,31 @@
+#ifndef GLUTILS_H
+#define GLUTILS_H
+
+// OpenGL entry points above 1.1, as declared by the system headers.
+// Include this before GLFW with GLFW_INCLUDE_NONE defined.
+#if defined(__APPLE__)
+#include <OpenGL/gl3.h>
+#else
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+#include <cstddef>
+
+// Version of the current context is at least major.minor
+bool glVersionAtLeast(int major, int minor);
+
+// The current context exposes the extension
+bool glHasExtension(const char* name);
+
+// Print the errors and warnings of the context as the calls raise them (OpenGL 4.3 or KHR_debug).
+// Most drivers only report them in debug contexts. Returns false if not supported.
+bool glEnableDebugOutput();
+
+// Bytes of one pixel of the given client format and type
+size_t glPixelSize(GLenum format, GLenum type);
+
+#endif // GLUTILS_H
@@ -1,7 +1,25 @@
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <opencv2/highgui.hpp>
+#include "glutils.h"
+#define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include "linmath.h"
+#include "texture_stream.h"
+#include "mapped_frames.h"
+#include "offscreen.h"
+#include "quad_renderer.h"
+#include "mosaic.h"
+#include "frame_converter.h"
+#include "frame_queue.h"
+#include "frame_timer.h"
+#include "tiled_image.h"
 
 using namespace std;
 using namespace cv;
@@ -11,12 +29,18 @@ using namespace cv;
 #define TRACE  __FILE__ "\nLine:" TOSTRING(__LINE__)  "\n"
 #define TRACE_STR(str) str "\n" TRACE
 
+// glGetError waits for the driver, only check in debug builds. With USE_KHR_DEBUG the context reports the errors
+// through a callback instead.
+#if defined(NDEBUG) || defined(USE_KHR_DEBUG)
+#define GLCHECK
+#else
 #define GLCHECK {int error = glGetError(); \
 if (error != 0) { \
 printf("ErrorGL: %i\n", error); \
 printf(TRACE); \
 return 1; \
 }}
+#endif
 
 const static char* shaderV_glsl = ""
 "// Vertex Shader \n"
@@ -79,134 +103,375 @@ static void error_callback(int error, const char* description)
 	fprintf(stderr, "Error: %s\n", description);
 }
 
+// Synthetic camera frame: the square moves along the first rows
+static void drawFrame(Mat& frame, const Mat& square, const int index)
+{
+	frame.setTo(Scalar::all(0));
+	const int x = (index * 4) % max(1, frame.cols - square.cols);
+	square.copyTo(frame(Rect(Point(x, 50), square.size())));
+}
+
+// Synthetic raw camera frame of the layout, converted to RGB by the shader
+static void makeRawFrame(Mat& raw, const FrameLayout layout, const int width, const int height, const int index)
+{
+	const int shift = index * 4;
+	switch (layout)
+	{
+	case FRAME_NV12:
+		raw.create(height * 3 / 2, width, CV_8UC1);
+		for (int y = 0; y < height; ++y)
+		{
+			uchar* row = raw.ptr<uchar>(y);
+			for (int x = 0; x < width; ++x)
+				row[x] = static_cast<uchar>(16 + (x + shift) % 220);
+		}
+		for (int y = 0; y < height / 2; ++y)
+		{
+			uchar* row = raw.ptr<uchar>(height + y);
+			for (int x = 0; x < width; x += 2)
+			{
+				row[x] = static_cast<uchar>(16 + y * 224 / (height / 2));
+				row[x + 1] = static_cast<uchar>(16 + x * 224 / width);
+			}
+		}
+		break;
+	case FRAME_YUYV:
+		raw.create(height, width, CV_8UC2);
+		for (int y = 0; y < height; ++y)
+		{
+			uchar* row = raw.ptr<uchar>(y);
+			for (int x = 0; x < width; x += 2)
+			{
+				row[2 * x] = static_cast<uchar>(16 + (x + shift) % 220);
+				row[2 * x + 1] = static_cast<uchar>(16 + y * 224 / height);
+				row[2 * x + 2] = static_cast<uchar>(16 + (x + 1 + shift) % 220);
+				row[2 * x + 3] = static_cast<uchar>(16 + x * 224 / width);
+			}
+		}
+		break;
+	case FRAME_DEPTH16:
+		// 500 to 4500 mm, with an invalid band
+		raw.create(height, width, CV_16UC1);
+		for (int y = 0; y < height; ++y)
+		{
+			ushort* row = raw.ptr<ushort>(y);
+			for (int x = 0; x < width; ++x)
+				row[x] = (y / 16) % 8 == 7 ? 0 : static_cast<ushort>(500 + (x + shift) % width * 4000 / width);
+		}
+		break;
+	case FRAME_FLOAT32:
+		raw.create(height, width, CV_32FC1);
+		for (int y = 0; y < height; ++y)
+		{
+			float* row = raw.ptr<float>(y);
+			for (int x = 0; x < width; ++x)
+				row[x] = static_cast<float>((x + shift) % width) / width;
+		}
+		break;
+	default:
+		raw.create(height, width, CV_8UC3);
+		raw.setTo(Scalar(255, 0, 0));
+		break;
+	}
+}
+
+// Camera thread delivering synthetic frames at a fixed rate, whatever the render loop does
+class SyntheticCapture
+{
+public:
+	SyntheticCapture()
+		: running(false), skipped(0)
+	{
+	}
+
+	~SyntheticCapture()
+	{
+		stop();
+	}
+
+	// A new buffer for each frame, the render thread owns the ones it takes
+	void start(LatestFrameQueue<Mat>& queue, const Mat& square, const Size& size, const int fps)
+	{
+		run(fps, [&queue, square, size](const int index) -> bool
+		{
+			Mat frame(size, CV_8UC3);
+			drawFrame(frame, square, index);
+			queue.push(std::move(frame));
+			return true;
+		});
+	}
+
+	// Frames written in place into the mapped slots of pool, through cv::Mat headers. Without a free slot the
+	// frame is skipped, as a camera out of buffers would.
+	void start(LatestFrameQueue<MappedFrame>& queue, MappedFramePool& pool, const Mat& square, const Size& size, const int fps)
+	{
+		run(fps, [&queue, &pool, square, size](const int index) -> bool
+		{
+			MappedFrame frame = pool.tryAcquire();
+			if (!frame.valid())
+				return false;
+			Mat image(size, CV_8UC3, frame.data(), pool.step());
+			drawFrame(image, square, index);
+			queue.push(std::move(frame));
+			return true;
+		});
+	}
+
+	void stop()
+	{
+		running = false;
+		if (worker.joinable())
+			worker.join();
+	}
+
+	// Frames skipped for lack of a buffer
+	size_t numSkipped() const
+	{
+		return skipped.load();
+	}
+
+private:
+	void run(const int fps, const function<bool(int)>& produce)
+	{
+		running = true;
+		skipped = 0;
+		worker = thread([this, produce, fps]()
+		{
+			const chrono::microseconds period(1000000 / fps);
+			chrono::steady_clock::time_point next = chrono::steady_clock::now();
+			for (int index = 0; running; ++index)
+			{
+				if (!produce(index))
+					skipped++;
+				next += period;
+				this_thread::sleep_until(next);
+			}
+		});
+	}
+
+	atomic<bool> running;
+	atomic<size_t> skipped;
+	thread worker;
+};
+
+// Stages of the render loop measured with --timing
+enum LoopStage
+{
+	STAGE_PREPARE, // frame generated or taken from the capture queue
+	STAGE_UPLOAD,
+	STAGE_DRAW,
+	STAGE_SWAP     // swap buffers, or read back the frame when headless
+};
+
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GLFW_TRUE);
 }
 
+// Wheel steps not applied to the zoom yet
+static double scrollSteps = 0.;
+
+static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	scrollSteps += yoffset;
+}
+
 int main(int argc, char* argv[])
 {
-	std::shared_ptr<float> pVertices;
-	std::shared_ptr<float> pUV;
+	// --stream [width height]: upload a new frame every vsync
+	// --zerocopy: with --stream or --capture, write the frames directly into mapped GL memory
+	// --headless [frames]: render that many frames offscreen, without a window
+	// --out file: with --headless, save the last frame
+	// --mosaic N: show N streams in a grid
+	// --format bgr|nv12|yuyv|depth16|float: raw frames converted by the shader, --colormap gray|jet|turbo for depth and float
+	// --capture fps [depth]: frames produced by a capture thread, the newest one is shown
+	// --image file: pan (left button) and zoom (wheel) over a large image drawn from tiles, zoom from the whole
+	// image to 1:1 when headless
+	// --timing [file.csv]: CPU and GPU time of each stage of the loop, p50 and p99 printed at exit and saved to the file
+	bool streaming = false;
+	bool zeroCopy = false;
+	bool headless = false;
+	int numFrames = 300;
+	const char* outputPath = NULL;
+	int numMosaic = 0;
+	bool rawFrames = false;
+	FrameLayout layout = FRAME_BGR8;
+	Colormap colormap = COLORMAP_TURBO;
+	const char* imagePath = NULL;
+	bool timing = false;
+	const char* timingPath = NULL;
+	int captureFps = 0;
+	int queueDepth = 1;
+	int frameWidth = 640;
+	int frameHeight = 480;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--stream") == 0)
+		{
+			streaming = true;
+			if (i + 2 < argc && atoi(argv[i + 1]) > 0 && atoi(argv[i + 2]) > 0)
+			{
+				frameWidth = atoi(argv[i + 1]);
+				frameHeight = atoi(argv[i + 2]);
+				i += 2;
+			}
+		}
+		else if (strcmp(argv[i], "--zerocopy") == 0)
+			zeroCopy = true;
+		else if (strcmp(argv[i], "--headless") == 0)
+		{
+			headless = true;
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+				numFrames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			outputPath = argv[++i];
+		else if (strcmp(argv[i], "--mosaic") == 0 && i + 1 < argc)
+			numMosaic = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+		{
+			const char* name = argv[++i];
+			rawFrames = true;
+			if (strcmp(name, "nv12") == 0)
+				layout = FRAME_NV12;
+			else if (strcmp(name, "yuyv") == 0)
+				layout = FRAME_YUYV;
+			else if (strcmp(name, "depth16") == 0)
+				layout = FRAME_DEPTH16;
+			else if (strcmp(name, "float") == 0)
+				layout = FRAME_FLOAT32;
+		}
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+		{
+			captureFps = atoi(argv[++i]);
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+				queueDepth = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc)
+			imagePath = argv[++i];
+		else if (strcmp(argv[i], "--timing") == 0)
+		{
+			timing = true;
+			if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+				timingPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--colormap") == 0 && i + 1 < argc)
+		{
+			const char* name = argv[++i];
+			colormap = strcmp(name, "gray") == 0 ? COLORMAP_GRAY : strcmp(name, "jet") == 0 ? COLORMAP_JET : COLORMAP_TURBO;
+		}
+	}
+
 	GLuint m_texture;
 
-	//initialize rectangle
-	float left = -1;
-	float top = 1;
-	float w = 2;
-	float h = 2;
-	float z = 0.5f;
-	pVertices = std::shared_ptr<float>(new float[12]{
-		left, top - h, z,
-		left, top, z,
-		left + w, top - h, z,
-		left + w, top, z
-
-	}, std::default_delete<float[]>());
-	pUV = std::shared_ptr<float>(new float[9]{
-		0.f, 1.f,
-		0.f, 0.f,
-		1.f, 1.f,
-		1.f, 0.f
-
-	}, std::default_delete<float[]>());
-
-	Mat img(480, 640, CV_8UC3, Scalar::all(0));
+	Mat img(frameHeight, frameWidth, CV_8UC3, Scalar::all(0));
 	Mat img2(300, 300, CV_8UC3, Scalar(0, 0, 255));
 	img2.copyTo(img(Rect(Point(50, 50), img2.size())));
 
-	GLFWwindow* window;
-	GLuint vertex_buffer, vertex_shader, fragment_shader, program;
-	GLint mvp_location, vpos_location, vcol_location;
-
-	glfwSetErrorCallback(error_callback);
+	GLFWwindow* window = NULL;
+	GLuint program;
 
-	if (!glfwInit())
+	// without a window the frames are rendered into a framebuffer object and read back
+	OffscreenContext offscreen;
+	OffscreenTarget target;
+	AsyncReadback readback;
+	if (headless)
 	{
-		printf("glfw not initialized\n");
-		return 1;
+		if (!offscreen.create())
+		{
+			printf("Offscreen context not created\n");
+			return 1;
+		}
+		printf("Renderer: %s\n", glGetString(GL_RENDERER));
 	}
-
-	window = glfwCreateWindow(640, 480, "Simple example", NULL, NULL);
-	if (!window)
+	else
 	{
-		glfwTerminate();
-		exit(EXIT_FAILURE);
-	}
+		glfwSetErrorCallback(error_callback);
 
-	glfwSetKeyCallback(window, key_callback);
-	glfwMakeContextCurrent(window);
-	glfwSwapInterval(1);
+		if (!glfwInit())
+		{
+			printf("glfw not initialized\n");
+			return 1;
+		}
 
-//	glGenBuffers(1, &vertex_buffer);
-//	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-//	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+#ifdef USE_KHR_DEBUG
+		glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+#endif
+		window = glfwCreateWindow(640, 480, "Simple example", NULL, NULL);
+		if (!window)
+		{
+			glfwTerminate();
+			exit(EXIT_FAILURE);
+		}
+
+		glfwSetKeyCallback(window, key_callback);
+		glfwSetScrollCallback(window, scroll_callback);
+		glfwMakeContextCurrent(window);
+		glfwSwapInterval(1);
+	}
+#ifdef USE_KHR_DEBUG
+	if (!glEnableDebugOutput())
+		printf("KHR_debug not supported\n");
+#endif
 
-	//Initialize texture
-	int error;
-	glGenTextures(1, &m_texture);
-	if (!m_texture)
+	//Initialize texture, its storage is allocated once and updated through pixel buffers
+	TextureStream stream;
+	if (!stream.init(img.cols, img.rows, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE))
 	{
 		printf("Error creating texture\n");
-		return false;
+		return 1;
 	}
-	const int type = GL_RGB;
-	glActiveTexture(GL_TEXTURE0);
-	GLCHECK
-	glBindTexture(GL_TEXTURE_2D, m_texture);
-	GLCHECK
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	GLCHECK
-	glTexImage2D(GL_TEXTURE_2D, 0, type, img.cols, img.rows, 0, type, GL_UNSIGNED_BYTE, img.ptr<uchar>(0));
-	GLCHECK
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	GLCHECK
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	GLCHECK
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	GLCHECK
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	GLCHECK
-
-	vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-	GLCHECK
-	glShaderSource(vertex_shader, 1, &shaderV_glsl, NULL);
-	GLCHECK
-	glCompileShader(vertex_shader);
-	GLCHECK
-	GLint status;
-	glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &status);
-	if (status != GL_TRUE)
+	m_texture = stream.texture();
+	if (!stream.upload(img.ptr<uchar>(0), img.step[0]))
 	{
-		printf("Error vertex shader\n");
+		printf("Error uploading texture\n");
 		return 1;
 	}
-	fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-	GLCHECK
-	glShaderSource(fragment_shader, 1, &shaderF_glsl, NULL);
 	GLCHECK
-	glCompileShader(fragment_shader);
-	GLCHECK
-	glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &status);
-	if (status != GL_TRUE)
+
+	// frames written in place: cv::Mat headers over the mapped slots, no copy on upload. With --capture the slots
+	// also cover the one being written, the queueDepth + 2 kept by the queue and the ones read by the GPU.
+	MappedFramePool framePool;
+	if (zeroCopy && (streaming || captureFps > 0))
 	{
-		printf("Error fragment shader\n");
-		return 1;
+		const int numSlots = captureFps > 0 ? queueDepth + 6 : 3;
+		if (framePool.init(img.cols, img.rows, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, numSlots))
+			m_texture = framePool.texture();
+		else
+		{
+			printf("Persistent mapping not supported, uploading with copies\n");
+			zeroCopy = false;
+		}
 	}
-	program = glCreateProgram();
-	GLCHECK
-	glAttachShader(program, vertex_shader);
-	GLCHECK
-	glAttachShader(program, fragment_shader);
-	GLCHECK
-	glLinkProgram(program);
 	GLCHECK
-	glGetProgramiv(program, GL_LINK_STATUS, &status);
-	if (status != GL_TRUE)
-	{
-		printf("Unable to link shader\n");
+
+	// program, locations and quad buffer are set up once
+	QuadRenderer renderer;
+	if (!renderer.init(shaderV_glsl, shaderF_glsl))
 		return 1;
+	program = renderer.program();
+	GLint status;
+
+	// raw frames only copied by the CPU, converted to RGB on the GPU
+	FrameConverter converter;
+	Mat rawFrame;
+	if (rawFrames)
+	{
+		if (!converter.init(layout, img.cols, img.rows))
+			return 1;
+		converter.setColormap(colormap);
+	}
+
+	// all streams in the layers of one texture array, drawn in one call
+	MosaicRenderer mosaic;
+	vector<Mat> mosaicFrames;
+	if (numMosaic > 0)
+	{
+		if (!mosaic.init(numMosaic, img.cols, img.rows, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE))
+			return 1;
+		for (int i = 0; i < numMosaic; ++i)
+			mosaicFrames.push_back(Mat(img.rows, img.cols, CV_8UC3, Scalar::all(0)));
 	}
 	glValidateProgram(program);
 	GLCHECK
@@ -219,15 +484,80 @@ int main(int argc, char* argv[])
 
 	printf("Program: %d\n", program);
 
+	// read back frame N while rendering frame N+1
+	Mat result(img.rows, img.cols, CV_8UC3);
+	if (headless)
+	{
+		if (!target.init(img.cols, img.rows) || !readback.init(img.cols, img.rows, GL_BGR, GL_UNSIGNED_BYTE, 2))
+		{
+			printf("Error creating the offscreen target\n");
+			return 1;
+		}
+	}
+	GLCHECK
+
+	// images larger than the textures, only the visible tiles of the matching pyramid level are uploaded
+	TiledImage tiles;
+	Mat bigImage;
+	double viewX = 0., viewY = 0., viewZoom = 0.;
+	double lastCursorX = 0., lastCursorY = 0.;
+	bool dragging = false;
+	if (imagePath)
+	{
+		bigImage = imread(imagePath);
+		if (bigImage.empty())
+		{
+			printf("Error reading %s\n", imagePath);
+			return 1;
+		}
+		if (!tiles.init(bigImage.ptr<uchar>(0), bigImage.step[0], bigImage.cols, bigImage.rows))
+			return 1;
+		viewX = bigImage.cols * 0.5;
+		viewY = bigImage.rows * 0.5;
+		printf("Image %dx%d: %d levels, %d tiles in the cache\n", bigImage.cols, bigImage.rows, tiles.numLevels(), tiles.capacity());
+	}
 
-	while (!glfwWindowShouldClose(window))
+	// GPU times read a frame late, the loop does not wait for them
+	FrameTimer timer;
+	if (timing)
 	{
+		const char* stageNames[] = { "prepare", "upload", "draw", "swap" };
+		if (!timer.init(vector<string>(stageNames, stageNames + 4), 2))
+			return 1;
+	}
+
+	// the capture thread never waits for the render loop, stale frames are dropped
+	LatestFrameQueue<Mat> frameQueue(queueDepth);
+	LatestFrameQueue<MappedFrame> mappedQueue(queueDepth);
+	SyntheticCapture capture;
+	if (captureFps > 0 && zeroCopy)
+		capture.start(mappedQueue, framePool, img2, img.size(), captureFps);
+	else if (captureFps > 0)
+		capture.start(frameQueue, img2, img.size(), captureFps);
+
+	int frame = 0;
+	int numRendered = 0;
+	const double startTime = static_cast<double>(getTickCount());
+
+	while (headless ? numRendered < numFrames : !glfwWindowShouldClose(window))
+	{
+		timer.beginFrame();
+		timer.beginStage(STAGE_PREPARE);
 		float ratio;
 		int width, height;
 //		mat4x4 m, p, mvp;
-		glfwGetFramebufferSize(window, &width, &height);
+		if (headless)
+		{
+			target.bind();
+			width = target.width();
+			height = target.height();
+		}
+		else
+		{
+			glfwGetFramebufferSize(window, &width, &height);
+			glViewport(0, 0, width, height);
+		}
 		ratio = width / (float) height;
-		glViewport(0, 0, width, height);
 //		glClear(GL_COLOR_BUFFER_BIT);
 //		mat4x4_identity(m);
 //		mat4x4_rotate_Z(m, m, (float) glfwGetTime());
@@ -237,49 +567,217 @@ int main(int argc, char* argv[])
 //		glUniformMatrix4fv(mvp_location, 1, GL_FALSE, (const GLfloat*) mvp);
 //		glDrawArrays(GL_TRIANGLES, 0, 3);
 
+		if (captureFps > 0 && zeroCopy)
+		{
+			// the slots the GPU finished reading go back to the capture thread
+			framePool.recycle();
+			MappedFrame captured;
+			double ageMs = 0.;
+			const bool newFrame = mappedQueue.popLatest(captured, &ageMs);
+			timer.beginStage(STAGE_UPLOAD);
+			if (newFrame && !framePool.submit(captured))
+			{
+				printf("Error uploading texture\n");
+				return 1;
+			}
+			GLCHECK
+			if (++frame % 120 == 0)
+				printf("Captured %zu, shown %zu, dropped %zu, late %zu, skipped %zu, last age %.2f ms\n", mappedQueue.numPushed(),
+					mappedQueue.numTaken(), mappedQueue.numDropped(), mappedQueue.numLate(), capture.numSkipped(), ageMs);
+		}
+		else if (streaming && zeroCopy)
+		{
+			const int slot = framePool.acquire();
+			Mat frameSlot(img.rows, img.cols, CV_8UC3, framePool.data(slot), framePool.step());
+			drawFrame(frameSlot, img2, frame);
+			timer.beginStage(STAGE_UPLOAD);
+			framePool.submit(slot);
+			GLCHECK
+			if (++frame % 120 == 0)
+				printf("Frames %d, waits for the GPU %zu\n", frame, framePool.numWaits());
+		}
+		else if (captureFps > 0)
+		{
+			Mat captured;
+			double ageMs = 0.;
+			const bool newFrame = frameQueue.popLatest(captured, &ageMs);
+			timer.beginStage(STAGE_UPLOAD);
+			if (newFrame && !stream.upload(captured.ptr<uchar>(0), captured.step[0]))
+			{
+				printf("Error uploading texture\n");
+				return 1;
+			}
+			GLCHECK
+			if (++frame % 120 == 0)
+				printf("Captured %zu, shown %zu, dropped %zu, late %zu, last age %.2f ms\n", frameQueue.numPushed(),
+					frameQueue.numTaken(), frameQueue.numDropped(), frameQueue.numLate(), ageMs);
+		}
+		else if (streaming)
+		{
+			drawFrame(img, img2, frame);
+			timer.beginStage(STAGE_UPLOAD);
+			if (!stream.upload(img.ptr<uchar>(0), img.step[0]))
+			{
+				printf("Error uploading texture\n");
+				return 1;
+			}
+			GLCHECK
+			if (++frame % 120 == 0)
+				printf("Upload %dx%d: %.2f ms (average %.2f ms)\n", img.cols, img.rows, stream.lastUploadMs(), stream.averageUploadMs());
+		}
+
+		if (imagePath)
+		{
+			const double fit = tiles.fitZoom(width, height);
+			if (headless)
+				viewZoom = fit * pow(1. / fit, numRendered / max(1., numFrames - 1.));
+			else
+			{
+				// cursor in framebuffer pixels
+				int windowWidth, windowHeight;
+				double cursorX, cursorY;
+				glfwGetWindowSize(window, &windowWidth, &windowHeight);
+				glfwGetCursorPos(window, &cursorX, &cursorY);
+				cursorX *= width / static_cast<double>(max(1, windowWidth));
+				cursorY *= height / static_cast<double>(max(1, windowHeight));
+				if (viewZoom == 0.)
+					viewZoom = fit;
+
+				// the image point under the cursor stays in place
+				if (scrollSteps != 0.)
+				{
+					const double pointX = viewX + (cursorX - width * 0.5) / viewZoom;
+					const double pointY = viewY + (cursorY - height * 0.5) / viewZoom;
+					viewZoom = min(max(viewZoom * pow(1.25, scrollSteps), fit * 0.5), 32.);
+					scrollSteps = 0.;
+					viewX = pointX - (cursorX - width * 0.5) / viewZoom;
+					viewY = pointY - (cursorY - height * 0.5) / viewZoom;
+				}
+				const bool pressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+				if (pressed && dragging)
+				{
+					viewX -= (cursorX - lastCursorX) / viewZoom;
+					viewY -= (cursorY - lastCursorY) / viewZoom;
+				}
+				dragging = pressed;
+				lastCursorX = cursorX;
+				lastCursorY = cursorY;
+			}
+			tiles.setView(viewX, viewY, viewZoom);
+		}
+		else if (numMosaic > 0)
+		{
+			// stream i delivers a frame every i % 4 + 1 vsyncs, only those layers are uploaded
+			for (int i = 0; i < numMosaic; ++i)
+			{
+				if (numRendered % (i % 4 + 1) == 0)
+					drawFrame(mosaicFrames[i], img2, numRendered + 20 * i);
+			}
+			timer.beginStage(STAGE_UPLOAD);
+			for (int i = 0; i < numMosaic; ++i)
+			{
+				if (numRendered % (i % 4 + 1) == 0)
+					mosaic.update(i, mosaicFrames[i].ptr<uchar>(0), mosaicFrames[i].step[0]);
+			}
+		}
+		else if (rawFrames)
+		{
+			makeRawFrame(rawFrame, layout, img.cols, img.rows, numRendered);
+			timer.beginStage(STAGE_UPLOAD);
+			if (!converter.upload(rawFrame.ptr<uchar>(0), rawFrame.step[0]))
+			{
+				printf("Error uploading texture\n");
+				return 1;
+			}
+		}
+
+		timer.beginStage(STAGE_DRAW);
 		glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 		GLCHECK
 		glClearColor(0,0,0,1);
 		GLCHECK
 
-		glUseProgram(program);
-		GLCHECK
-
-		glActiveTexture(GL_TEXTURE0);
-		GLCHECK
-		glBindTexture(GL_TEXTURE_2D, m_texture);
-		GLCHECK
-
-		int mTextureUniformHandle = glGetUniformLocation(program, "tex");
-		GLCHECK
-		glUniform1i(mTextureUniformHandle, 0);
-		GLCHECK
-
-		// get the attribute and uniform locations
-		GLuint m_pos = glGetAttribLocation(program, "pos");
-		GLCHECK
-		GLuint m_uv = glGetAttribLocation(program, "uv");
-		GLCHECK
-
-		// load the attribute data
-		glEnableVertexAttribArray(m_pos);
-		GLCHECK
-		glVertexAttribPointer(m_pos, 3, GL_FLOAT, GL_TRUE, 0, pVertices.get());
-		GLCHECK
-		glEnableVertexAttribArray(m_uv);
-		GLCHECK
-		glVertexAttribPointer(m_uv, 2, GL_FLOAT, GL_TRUE, 0, pUV.get());
-		GLCHECK
-
 		//Draw
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		if (imagePath)
+		{
+			// the missing tiles are uploaded while drawing
+			tiles.draw(width, height);
+			GLCHECK
+			if (numRendered % 120 == 0)
+				printf("Zoom %.3f: level %d, %d tiles uploaded, %d of %d resident\n", viewZoom, tiles.lastLevel(),
+					tiles.lastUploads(), tiles.numResident(), tiles.capacity());
+		}
+		else if (numMosaic > 0)
+		{
+			const double uploadMs = mosaic.uploadMs();
+			mosaic.draw();
+			GLCHECK
+			if (numRendered % 120 == 0)
+				printf("Mosaic of %d %dx%d: upload %.2f ms\n", numMosaic, img.cols, img.rows, uploadMs);
+		}
+		else if (rawFrames)
+		{
+			converter.draw();
+			GLCHECK
+			if (numRendered % 120 == 0)
+				printf("Raw frame upload %dx%d: %.2f ms\n", img.cols, img.rows, converter.lastUploadMs());
+		}
+		else
+			renderer.draw(m_texture);
 		GLCHECK
 
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		timer.beginStage(STAGE_SWAP);
+		numRendered++;
+		if (headless)
+		{
+			// retrieve the oldest frame once the ring is full, it has been rendered a frame ago
+			if (readback.pending() == 2)
+				readback.retrieve(result.ptr<uchar>(0), result.step[0], true);
+			readback.request(target.framebuffer());
+			GLCHECK
+		}
+		else
+		{
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+		timer.endFrame();
+	}
+
+	capture.stop();
+	if (headless)
+	{
+		while (readback.pending() > 0)
+			readback.retrieve(result.ptr<uchar>(0), result.step[0], true);
+		const double elapsedMs = (getTickCount() - startTime) * 1000. / getTickFrequency();
+		printf("Rendered %d frames %dx%d: %.2f ms per frame\n", numRendered, img.cols, img.rows, elapsedMs / max(1, numRendered));
+
+		// OpenGL rows start at the bottom
+		flip(result, result, 0);
+		if (outputPath && !imwrite(outputPath, result))
+			printf("Error writing %s\n", outputPath);
+	}
+	if (timing)
+	{
+		timer.printSummary();
+		if (timingPath && !timer.writeCsv(timingPath))
+			printf("Error writing %s\n", timingPath);
+	}
+	timer.release();
+	tiles.release();
+	mosaic.release();
+	converter.release();
+	renderer.release();
+	readback.release();
+	target.release();
+	framePool.release();
+	stream.release();
+	if (window)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
 	}
-	glfwDestroyWindow(window);
-	glfwTerminate();
+	offscreen.destroy();
 
 
 //	imshow("img", img);
@@ -0,0 +1,239 @@
+#include "mapped_frames.h"
+
+using namespace std;
+
+MappedFrame::MappedFrame(MappedFrame&& other)
+	: pool(other.pool), slot(other.slot), generation(other.generation), memory(other.memory)
+{
+	other.slot = -1;
+	other.memory = NULL;
+}
+
+MappedFrame& MappedFrame::operator=(MappedFrame&& other)
+{
+	if (this != &other)
+	{
+		reset();
+		pool = other.pool;
+		slot = other.slot;
+		generation = other.generation;
+		memory = other.memory;
+		other.slot = -1;
+		other.memory = NULL;
+	}
+	return *this;
+}
+
+MappedFrame::~MappedFrame()
+{
+	reset();
+}
+
+void MappedFrame::reset()
+{
+	if (slot >= 0)
+		pool->giveBack(slot, generation);
+	slot = -1;
+	memory = NULL;
+}
+
+MappedFramePool::MappedFramePool()
+	: tex(0), buffer(0), mapped(NULL), generation(0), texWidth(0), texHeight(0), pixelFormat(GL_RGB),
+	pixelType(GL_UNSIGNED_BYTE), rowBytes(0), frameBytes(0), waits(0)
+{
+}
+
+MappedFramePool::~MappedFramePool()
+{
+	// GL objects are only deleted by release, the context may be gone already
+}
+
+bool MappedFramePool::supported()
+{
+#ifdef GL_VERSION_4_4
+	return glVersionAtLeast(4, 4) || glHasExtension("GL_ARB_buffer_storage");
+#else
+	return false;
+#endif
+}
+
+bool MappedFramePool::init(int width, int height, GLenum internalFormat, GLenum format, GLenum type, int numSlots)
+{
+	release();
+	if (width <= 0 || height <= 0 || numSlots < 1 || !supported())
+		return false;
+#ifdef GL_VERSION_4_4
+	texWidth = width;
+	texHeight = height;
+	pixelFormat = format;
+	pixelType = type;
+	rowBytes = width * glPixelSize(format, type);
+	frameBytes = rowBytes * height;
+	waits = 0;
+
+	glGenTextures(1, &tex);
+	if (!tex)
+		return false;
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// all slots in one buffer, mapped for the lifetime of the pool. Coherent mapping makes the CPU writes visible
+	// to the GPU without explicit flushes.
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, frameBytes * numSlots, NULL, flags);
+	mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, frameBytes * numSlots, flags));
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!mapped)
+	{
+		release();
+		return false;
+	}
+	fences.assign(numSlots, static_cast<GLsync>(0));
+	submitted.clear();
+	{
+		lock_guard<mutex> guard(freeLock);
+		generation++;
+		freeSlots.clear();
+		for (int slot = numSlots - 1; slot >= 0; --slot)
+			freeSlots.push_back(slot);
+	}
+	return glGetError() == GL_NO_ERROR;
+#else
+	return false;
+#endif
+}
+
+void MappedFramePool::release()
+{
+	for (size_t i = 0; i < fences.size(); ++i)
+	{
+		if (fences[i])
+			glDeleteSync(fences[i]);
+	}
+	fences.clear();
+	submitted.clear();
+	{
+		lock_guard<mutex> guard(freeLock);
+		generation++;
+		freeSlots.clear();
+	}
+	if (mapped)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	mapped = NULL;
+	if (buffer)
+		glDeleteBuffers(1, &buffer);
+	buffer = 0;
+	if (tex)
+		glDeleteTextures(1, &tex);
+	tex = 0;
+}
+
+void MappedFramePool::recycle()
+{
+	// the copies complete in submission order
+	size_t numDone = 0;
+	while (numDone < submitted.size() &&
+		glClientWaitSync(fences[submitted[numDone]], GL_SYNC_FLUSH_COMMANDS_BIT, 0) != GL_TIMEOUT_EXPIRED)
+		numDone++;
+	if (numDone == 0)
+		return;
+
+	lock_guard<mutex> guard(freeLock);
+	for (size_t i = 0; i < numDone; ++i)
+	{
+		glDeleteSync(fences[submitted[i]]);
+		fences[submitted[i]] = 0;
+		freeSlots.push_back(submitted[i]);
+	}
+	submitted.erase(submitted.begin(), submitted.begin() + numDone);
+}
+
+int MappedFramePool::acquire()
+{
+	if (!mapped)
+		return -1;
+	recycle();
+	{
+		lock_guard<mutex> guard(freeLock);
+		if (!freeSlots.empty())
+		{
+			const int slot = freeSlots.back();
+			freeSlots.pop_back();
+			return slot;
+		}
+	}
+	if (submitted.empty())
+		return -1;
+
+	// the oldest slot is free once the copy to the texture that read it completed
+	const int slot = submitted.front();
+	submitted.erase(submitted.begin());
+	if (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+	{
+		waits++;
+		glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	}
+	glDeleteSync(fences[slot]);
+	fences[slot] = 0;
+	return slot;
+}
+
+MappedFrame MappedFramePool::tryAcquire()
+{
+	MappedFrame frame;
+	lock_guard<mutex> guard(freeLock);
+	if (freeSlots.empty())
+		return frame;
+	frame.pool = this;
+	frame.slot = freeSlots.back();
+	frame.generation = generation;
+	frame.memory = data(frame.slot);
+	freeSlots.pop_back();
+	return frame;
+}
+
+void MappedFramePool::giveBack(int slot, unsigned slotGeneration)
+{
+	lock_guard<mutex> guard(freeLock);
+	if (slotGeneration == generation)
+		freeSlots.push_back(slot);
+}
+
+bool MappedFramePool::submit(int slot)
+{
+	if (!mapped || slot < 0 || slot >= static_cast<int>(fences.size()))
+		return false;
+
+	// the buffer offset of the slot replaces the client pointer
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texWidth, texHeight, pixelFormat, pixelType,
+		reinterpret_cast<const void*>(slot * frameBytes));
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	submitted.push_back(slot);
+	return true;
+}
+
+bool MappedFramePool::submit(MappedFrame& frame)
+{
+	if (!frame.valid() || frame.pool != this || frame.generation != generation)
+		return false;
+	const int slot = frame.slot;
+	frame.slot = -1;
+	frame.memory = NULL;
+	return submit(slot);
+}
@@ -0,0 +1,140 @@
+#ifndef MAPPED_FRAMES_H
+#define MAPPED_FRAMES_H
+
+#include "glutils.h"
+#include <vector>
+#include <mutex>
+
+class MappedFramePool;
+
+// Slot of a MappedFramePool held by a producer thread, which writes its frame into data() (rows of pool.step()
+// bytes). Moved through frame queues like a cv::Mat. The slot goes back to the pool when the frame is destroyed or
+// replaced without being submitted, e.g. when a queue drops it.
+class MappedFrame
+{
+public:
+	MappedFrame()
+		: pool(NULL), slot(-1), generation(0), memory(NULL)
+	{
+	}
+
+	MappedFrame(MappedFrame&& other);
+	MappedFrame& operator=(MappedFrame&& other);
+	~MappedFrame();
+
+	MappedFrame(const MappedFrame&) = delete;
+	MappedFrame& operator=(const MappedFrame&) = delete;
+
+	// The frame holds a slot
+	bool valid() const
+	{
+		return slot >= 0;
+	}
+
+	unsigned char* data() const
+	{
+		return memory;
+	}
+
+private:
+	friend class MappedFramePool;
+
+	// Give the slot back to the pool
+	void reset();
+
+	MappedFramePool* pool;
+	int slot;
+	unsigned generation; // of the pool init the slot belongs to
+	unsigned char* memory;
+};
+
+// Frames written by their producer directly into persistently mapped GL buffer memory, then copied to a texture by
+// the GPU. Saves the CPU copy of TextureStream. Needs OpenGL 4.4 or ARB_buffer_storage.
+// Producer on the GL thread: slot = acquire(), write the frame to data(slot), submit(slot).
+// Producer on another thread: frame = tryAcquire(), write to frame.data(), hand the frame to the GL thread (e.g.
+// through a LatestFrameQueue<MappedFrame>), which calls submit(frame). The GL thread calls recycle() once per
+// rendered frame to give the slots the GPU finished reading back to the producers.
+class MappedFramePool
+{
+public:
+	MappedFramePool();
+	~MappedFramePool();
+
+	MappedFramePool(const MappedFramePool&) = delete;
+	MappedFramePool& operator=(const MappedFramePool&) = delete;
+
+	// The current context supports persistent mapping
+	static bool supported();
+
+	// Allocate the texture and numSlots frames of mapped memory. format and type describe the written pixels.
+	// With producers on other threads, numSlots covers the frames they hold and queue plus the ones read by the GPU.
+	bool init(int width, int height, GLenum internalFormat, GLenum format, GLenum type, int numSlots = 3);
+
+	// Unmap and delete the GL objects. Needs the context of init to be current and the producers to be stopped.
+	// Frames still held afterwards no longer give their slot back.
+	void release();
+
+	// GL thread: free the slots whose copy to the texture completed, without waiting for the GPU
+	void recycle();
+
+	// GL thread: index of a free slot, waiting for the GPU to finish reading the oldest submitted one if none is.
+	// -1 if not initialized or if producers hold all the slots.
+	int acquire();
+
+	// Any thread: a free slot to write a frame into. Invalid if none is free, a capture thread then skips the
+	// frame as a camera out of buffers would.
+	MappedFrame tryAcquire();
+
+	// Frame memory of a slot, valid until release
+	unsigned char* data(int slot) const
+	{
+		return mapped + slot * frameBytes;
+	}
+
+	// Bytes between the rows of a frame
+	size_t step() const
+	{
+		return rowBytes;
+	}
+
+	// GL thread: update the texture from the frame written to the slot
+	bool submit(int slot);
+
+	// GL thread: same with the slot of a frame, which no longer holds it
+	bool submit(MappedFrame& frame);
+
+	GLuint texture() const
+	{
+		return tex;
+	}
+
+	// Number of acquire calls that had to wait for the GPU
+	size_t numWaits() const
+	{
+		return waits;
+	}
+
+private:
+	friend class MappedFrame;
+
+	// Any thread: make a slot of the given init available to the producers
+	void giveBack(int slot, unsigned slotGeneration);
+
+	GLuint tex;
+	GLuint buffer;
+	unsigned char* mapped;
+	std::vector<GLsync> fences; // per slot, set while the GPU may read it
+	std::vector<int> submitted; // slots with a fence, oldest first (GL thread only)
+	std::mutex freeLock;        // guards freeSlots and generation
+	std::vector<int> freeSlots;
+	unsigned generation;        // incremented by init and release, frames of other generations are ignored
+	int texWidth;
+	int texHeight;
+	GLenum pixelFormat;
+	GLenum pixelType;
+	size_t rowBytes;
+	size_t frameBytes;
+	size_t waits;
+};
+
+#endif // MAPPED_FRAMES_H
@@ -0,0 +1,218 @@
+#include "mosaic.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+
+using namespace std;
+
+// corner is the position in the unit quad, rect (left, top, right, bottom) and layer are per tile
+static const char* mosaicVertexShader = ""
+"#version 130\n"
+"in vec2 corner;\n"
+"in vec4 rect;\n"
+"in float layer;\n"
+"out vec3 tex_uvw;\n"
+"\n"
+"void main()\n"
+"{\n"
+"	gl_Position = vec4(mix(rect.xy, rect.zw, corner), 0.5, 1.0);\n"
+"	tex_uvw = vec3(corner, layer);\n"
+"}\n";
+
+static const char* mosaicFragmentShader = ""
+"#version 130\n"
+"uniform sampler2DArray tex;\n"
+"in vec3 tex_uvw;\n"
+"\n"
+"void main()\n"
+"{\n"
+"	gl_FragColor = texture(tex, tex_uvw).bgra;\n"
+"}\n";
+
+MosaicRenderer::MosaicRenderer()
+	: prog(0), texArray(0), cornerBuffer(0), tileBuffer(0), vao(0), numLayers(0), layerWidth(0), layerHeight(0),
+	pixelFormat(GL_RGB), pixelType(GL_UNSIGNED_BYTE), rowBytes(0), pendingUploadMs(0.)
+{
+}
+
+static GLuint buildProgram(const char* vertexSource, const char* fragmentSource)
+{
+	const char* sources[2] = { vertexSource, fragmentSource };
+	const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	GLuint program = glCreateProgram();
+	for (int i = 0; i < 2; ++i)
+	{
+		GLuint shader = glCreateShader(types[i]);
+		glShaderSource(shader, 1, &sources[i], NULL);
+		glCompileShader(shader);
+		GLint status;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			char log[1024];
+			glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+			printf("Error mosaic shader: %s\n", log);
+			glDeleteShader(shader);
+			glDeleteProgram(program);
+			return 0;
+		}
+		glAttachShader(program, shader);
+		// deleted with the program
+		glDeleteShader(shader);
+	}
+	glLinkProgram(program);
+	GLint status;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE)
+	{
+		printf("Unable to link mosaic shader\n");
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+bool MosaicRenderer::init(int numImages, int width, int height, GLenum internalFormat, GLenum format, GLenum type, int columns)
+{
+	release();
+	if (numImages <= 0 || width <= 0 || height <= 0)
+		return false;
+	if (!glVersionAtLeast(3, 3))
+	{
+		printf("Mosaic needs OpenGL 3.3\n");
+		return false;
+	}
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	if (numImages > maxLayers)
+	{
+		printf("Mosaic of %d images, at most %d layers\n", numImages, maxLayers);
+		return false;
+	}
+	prog = buildProgram(mosaicVertexShader, mosaicFragmentShader);
+	if (!prog)
+		return false;
+	numLayers = numImages;
+	layerWidth = width;
+	layerHeight = height;
+	pixelFormat = format;
+	pixelType = type;
+	rowBytes = width * glPixelSize(format, type);
+
+	glGenTextures(1, &texArray);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texArray);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+#ifdef GL_VERSION_4_2
+	if (glVersionAtLeast(4, 2) || glHasExtension("GL_ARB_texture_storage"))
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, internalFormat, width, height, numImages);
+	else
+#endif
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, width, height, numImages, 0, format, type, NULL);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// tiles row by row from the top left, keeping a small gap between them
+	if (columns <= 0)
+		columns = static_cast<int>(ceil(sqrt(static_cast<double>(numImages))));
+	const int rows = (numImages + columns - 1) / columns;
+	const float tileWidth = 2.f / columns;
+	const float tileHeight = 2.f / rows;
+	const float gap = 0.01f;
+	vector<float> tiles;
+	for (int i = 0; i < numImages; ++i)
+	{
+		const float left = -1.f + (i % columns) * tileWidth;
+		const float top = 1.f - (i / columns) * tileHeight;
+		const float rect[5] = { left + gap, top - gap, left + tileWidth - gap, top - tileHeight + gap, static_cast<float>(i) };
+		tiles.insert(tiles.end(), rect, rect + 5);
+	}
+	static const float corners[8] = { 0.f, 0.f, 0.f, 1.f, 1.f, 0.f, 1.f, 1.f };
+
+	// one vertex array: the quad corners per vertex, the tile rectangle and layer per instance
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glGenBuffers(1, &cornerBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, cornerBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	const GLint cornerLocation = glGetAttribLocation(prog, "corner");
+	glEnableVertexAttribArray(cornerLocation);
+	glVertexAttribPointer(cornerLocation, 2, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const void*>(0));
+
+	glGenBuffers(1, &tileBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, tileBuffer);
+	glBufferData(GL_ARRAY_BUFFER, tiles.size() * sizeof(float), tiles.data(), GL_STATIC_DRAW);
+	const GLint rectLocation = glGetAttribLocation(prog, "rect");
+	const GLint layerLocation = glGetAttribLocation(prog, "layer");
+	const GLsizei stride = 5 * sizeof(float);
+	glEnableVertexAttribArray(rectLocation);
+	glVertexAttribPointer(rectLocation, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(0));
+	glVertexAttribDivisor(rectLocation, 1);
+	glEnableVertexAttribArray(layerLocation);
+	glVertexAttribPointer(layerLocation, 1, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(4 * sizeof(float)));
+	glVertexAttribDivisor(layerLocation, 1);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glUseProgram(prog);
+	glUniform1i(glGetUniformLocation(prog, "tex"), 0);
+	glUseProgram(0);
+	return glGetError() == GL_NO_ERROR;
+}
+
+void MosaicRenderer::release()
+{
+	if (vao)
+		glDeleteVertexArrays(1, &vao);
+	if (cornerBuffer)
+		glDeleteBuffers(1, &cornerBuffer);
+	if (tileBuffer)
+		glDeleteBuffers(1, &tileBuffer);
+	if (texArray)
+		glDeleteTextures(1, &texArray);
+	if (prog)
+		glDeleteProgram(prog);
+	vao = cornerBuffer = tileBuffer = texArray = prog = 0;
+	numLayers = 0;
+}
+
+void MosaicRenderer::update(int layer, const void* data, size_t step)
+{
+	if (layer < 0 || layer >= numLayers)
+		return;
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	// the driver copies the rows straight from the image when the row length describes its padding
+	const size_t pixelSize = glPixelSize(pixelFormat, pixelType);
+	const void* pixels = data;
+	if (step != rowBytes && step % pixelSize == 0)
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(step / pixelSize));
+	else if (step != rowBytes)
+	{
+		packed.resize(rowBytes * layerHeight);
+		for (int y = 0; y < layerHeight; ++y)
+			memcpy(&packed[y * rowBytes], static_cast<const unsigned char*>(data) + y * step, rowBytes);
+		pixels = packed.data();
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texArray);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, layerWidth, layerHeight, 1, pixelFormat, pixelType, pixels);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	pendingUploadMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void MosaicRenderer::draw()
+{
+	glUseProgram(prog);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texArray);
+	glBindVertexArray(vao);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numLayers);
+	glBindVertexArray(0);
+	pendingUploadMs = 0.;
+}
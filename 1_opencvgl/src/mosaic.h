@@ -0,0 +1,57 @@
+#ifndef MOSAIC_H
+#define MOSAIC_H
+
+#include "glutils.h"
+#include <vector>
+
+// Grid of same-size images drawn with a single instanced draw call. The images are the layers of a texture array,
+// each tile is an instance with its rectangle and layer. Only the layers given to update are uploaded.
+// Needs OpenGL 3.3 (texture arrays, instanced attributes).
+class MosaicRenderer
+{
+public:
+	MosaicRenderer();
+
+	MosaicRenderer(const MosaicRenderer&) = delete;
+	MosaicRenderer& operator=(const MosaicRenderer&) = delete;
+
+	// Allocate numImages layers of width x height pixels of the given format and type (e.g. GL_RGB and
+	// GL_UNSIGNED_BYTE for CV_8UC3 images) and lay them out in columns (0: as square as possible)
+	bool init(int numImages, int width, int height, GLenum internalFormat, GLenum format, GLenum type, int columns = 0);
+
+	void release();
+
+	// Replace the image of a layer with height rows of step bytes
+	void update(int layer, const void* data, size_t step);
+
+	// Draw all tiles into the current viewport
+	void draw();
+
+	int size() const
+	{
+		return numLayers;
+	}
+
+	// CPU time of the updates since the last draw, in milliseconds
+	double uploadMs() const
+	{
+		return pendingUploadMs;
+	}
+
+private:
+	GLuint prog;
+	GLuint texArray;
+	GLuint cornerBuffer;
+	GLuint tileBuffer;
+	GLuint vao;
+	int numLayers;
+	int layerWidth;
+	int layerHeight;
+	GLenum pixelFormat;
+	GLenum pixelType;
+	size_t rowBytes;
+	std::vector<unsigned char> packed; // rows of a padded image, copied without padding
+	double pendingUploadMs;
+};
+
+#endif // MOSAIC_H
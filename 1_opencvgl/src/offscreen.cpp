@@ -0,0 +1,280 @@
+#include "offscreen.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+using namespace std;
+
+OffscreenContext::OffscreenContext()
+	: display(NULL), surface(NULL), context(NULL)
+{
+}
+
+OffscreenContext::~OffscreenContext()
+{
+	destroy();
+}
+
+#ifdef HAVE_EGL
+// Whole-word search in an EGL extension string
+static bool eglHasExtension(const char* extensions, const char* name)
+{
+	const size_t length = strlen(name);
+	for (const char* p = extensions; p && (p = strstr(p, name)) != NULL; p += length)
+	{
+		if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+			return true;
+	}
+	return false;
+}
+#endif
+
+bool OffscreenContext::create()
+{
+	destroy();
+#ifdef HAVE_EGL
+	// a display that needs no window system when Mesa provides one
+	EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+	const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if (getPlatformDisplay && eglHasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+		eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (eglDisplay == EGL_NO_DISPLAY)
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, NULL, NULL))
+	{
+		printf("EGL display not available\n");
+		return false;
+	}
+	display = eglDisplay;
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		printf("EGL has no desktop OpenGL\n");
+		destroy();
+		return false;
+	}
+
+	// no surface at all when supported, else a pbuffer, the rendering goes to framebuffer objects anyway
+	const char* extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+	EGLConfig config = NULL;
+	EGLSurface eglSurface = EGL_NO_SURFACE;
+	if (!eglHasExtension(extensions, "EGL_KHR_surfaceless_context") || !eglHasExtension(extensions, "EGL_KHR_no_config_context"))
+	{
+		const EGLint configAttributes[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+			EGL_NONE };
+		EGLint numConfigs = 0;
+		if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &numConfigs) || numConfigs < 1)
+		{
+			printf("No EGL pbuffer config\n");
+			destroy();
+			return false;
+		}
+		const EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		eglSurface = eglCreatePbufferSurface(eglDisplay, config, surfaceAttributes);
+		surface = eglSurface;
+	}
+
+#ifdef USE_KHR_DEBUG
+	const EGLint contextAttributes[] = { EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE, EGL_NONE };
+#else
+	const EGLint contextAttributes[] = { EGL_NONE };
+#endif
+	EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+	if (eglContext == EGL_NO_CONTEXT)
+	{
+		printf("EGL context not created: 0x%x\n", eglGetError());
+		destroy();
+		return false;
+	}
+	context = eglContext;
+	if (!makeCurrent())
+	{
+		destroy();
+		return false;
+	}
+	return true;
+#else
+	printf("Offscreen rendering needs EGL\n");
+	return false;
+#endif
+}
+
+void OffscreenContext::destroy()
+{
+#ifdef HAVE_EGL
+	if (display)
+	{
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (context)
+			eglDestroyContext(display, context);
+		if (surface)
+			eglDestroySurface(display, surface);
+		eglTerminate(display);
+	}
+#endif
+	display = surface = context = NULL;
+}
+
+bool OffscreenContext::makeCurrent()
+{
+#ifdef HAVE_EGL
+	return context && eglMakeCurrent(display, surface ? surface : EGL_NO_SURFACE, surface ? surface : EGL_NO_SURFACE, context);
+#else
+	return false;
+#endif
+}
+
+OffscreenTarget::OffscreenTarget()
+	: fbo(0), color(0), depth(0), targetWidth(0), targetHeight(0)
+{
+}
+
+bool OffscreenTarget::init(int width, int height, GLenum internalFormat)
+{
+	release();
+	targetWidth = width;
+	targetHeight = height;
+
+	glGenTextures(1, &color);
+	glBindTexture(GL_TEXTURE_2D, color);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Framebuffer incomplete: 0x%x\n", status);
+		release();
+		return false;
+	}
+	return true;
+}
+
+void OffscreenTarget::release()
+{
+	if (fbo)
+		glDeleteFramebuffers(1, &fbo);
+	if (depth)
+		glDeleteRenderbuffers(1, &depth);
+	if (color)
+		glDeleteTextures(1, &color);
+	fbo = depth = color = 0;
+}
+
+void OffscreenTarget::bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, targetWidth, targetHeight);
+}
+
+AsyncReadback::AsyncReadback()
+	: first(0), numPending(0), readWidth(0), readHeight(0), pixelFormat(GL_BGR), pixelType(GL_UNSIGNED_BYTE), rowBytes(0)
+{
+}
+
+bool AsyncReadback::init(int width, int height, GLenum format, GLenum type, int numBuffers)
+{
+	release();
+	if (width <= 0 || height <= 0 || numBuffers < 1)
+		return false;
+	readWidth = width;
+	readHeight = height;
+	pixelFormat = format;
+	pixelType = type;
+	rowBytes = width * glPixelSize(format, type);
+
+	buffers.resize(numBuffers);
+	glGenBuffers(numBuffers, buffers.data());
+	for (size_t i = 0; i < buffers.size(); ++i)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, rowBytes * height, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	fences.assign(numBuffers, static_cast<GLsync>(0));
+	return glGetError() == GL_NO_ERROR;
+}
+
+void AsyncReadback::release()
+{
+	for (size_t i = 0; i < fences.size(); ++i)
+	{
+		if (fences[i])
+			glDeleteSync(fences[i]);
+	}
+	fences.clear();
+	if (!buffers.empty())
+		glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+	buffers.clear();
+	first = numPending = 0;
+}
+
+bool AsyncReadback::request(GLuint framebuffer)
+{
+	if (buffers.empty() || numPending == static_cast<int>(buffers.size()))
+		return false;
+	const int b = (first + numPending) % static_cast<int>(buffers.size());
+
+	// into the buffer, glReadPixels returns without waiting for the rendering
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[b]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, readWidth, readHeight, pixelFormat, pixelType, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	fences[b] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	numPending++;
+	return true;
+}
+
+bool AsyncReadback::retrieve(void* data, size_t step, bool wait)
+{
+	if (numPending == 0)
+		return false;
+	const GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+	const GLenum status = glClientWaitSync(fences[first], GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		return false;
+	glDeleteSync(fences[first]);
+	fences[first] = 0;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[first]);
+	const unsigned char* src = static_cast<const unsigned char*>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+	if (src)
+	{
+		unsigned char* dst = static_cast<unsigned char*>(data);
+		if (step == rowBytes)
+			memcpy(dst, src, rowBytes * readHeight);
+		else
+		{
+			for (int y = 0; y < readHeight; ++y)
+				memcpy(dst + y * step, src + y * rowBytes, rowBytes);
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	first = (first + 1) % static_cast<int>(buffers.size());
+	numPending--;
+	return src != NULL;
+}
@@ -0,0 +1,115 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include "glutils.h"
+#include <vector>
+
+// OpenGL context without a window, for servers and CI. Uses EGL (HAVE_EGL): surfaceless when the display supports
+// it, else a 1x1 pbuffer. Picks whatever driver EGL finds, including Mesa's llvmpipe software rasterizer.
+class OffscreenContext
+{
+public:
+	OffscreenContext();
+	~OffscreenContext();
+
+	OffscreenContext(const OffscreenContext&) = delete;
+	OffscreenContext& operator=(const OffscreenContext&) = delete;
+
+	// Create the context and make it current
+	bool create();
+
+	void destroy();
+
+	bool makeCurrent();
+
+private:
+	void* display;
+	void* surface;
+	void* context;
+};
+
+// Framebuffer object with a color texture, rendered into instead of a window
+class OffscreenTarget
+{
+public:
+	OffscreenTarget();
+
+	OffscreenTarget(const OffscreenTarget&) = delete;
+	OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+	bool init(int width, int height, GLenum internalFormat = GL_RGBA8);
+
+	void release();
+
+	// Render into the target, and set the viewport to its size
+	void bind();
+
+	GLuint framebuffer() const
+	{
+		return fbo;
+	}
+
+	GLuint colorTexture() const
+	{
+		return color;
+	}
+
+	int width() const
+	{
+		return targetWidth;
+	}
+
+	int height() const
+	{
+		return targetHeight;
+	}
+
+private:
+	GLuint fbo;
+	GLuint color;
+	GLuint depth;
+	int targetWidth;
+	int targetHeight;
+};
+
+// Reads frames back from a framebuffer through a ring of pixel pack buffers. request() only queues the copy,
+// so the readback of frame N overlaps the rendering of frame N+1; retrieve() maps the oldest queued frame.
+class AsyncReadback
+{
+public:
+	AsyncReadback();
+
+	AsyncReadback(const AsyncReadback&) = delete;
+	AsyncReadback& operator=(const AsyncReadback&) = delete;
+
+	// format and type of the read pixels, e.g. GL_BGR and GL_UNSIGNED_BYTE for a CV_8UC3 image
+	bool init(int width, int height, GLenum format, GLenum type, int numBuffers = 2);
+
+	void release();
+
+	// Queue the copy of the framebuffer. Returns false if all buffers hold frames not retrieved yet.
+	bool request(GLuint framebuffer);
+
+	// Copy the oldest queued frame to rows of step bytes, bottom row first as OpenGL stores it.
+	// Without wait, returns false if the GPU has not finished it yet.
+	bool retrieve(void* data, size_t step, bool wait);
+
+	// Number of frames queued and not retrieved
+	int pending() const
+	{
+		return numPending;
+	}
+
+private:
+	std::vector<GLuint> buffers;
+	std::vector<GLsync> fences;
+	int first; // oldest queued buffer
+	int numPending;
+	int readWidth;
+	int readHeight;
+	GLenum pixelFormat;
+	GLenum pixelType;
+	size_t rowBytes;
+};
+
+#endif // OFFSCREEN_H
@@ -0,0 +1,137 @@
+#include "quad_renderer.h"
+
+#include <cstdio>
+
+using namespace std;
+
+// Position (x, y, z) and texture coordinates (u, v) of the quad, as a triangle strip. The first image row is at v = 0.
+static const float quadVertices[] = {
+	-1.f, -1.f, 0.5f, 0.f, 1.f,
+	-1.f,  1.f, 0.5f, 0.f, 0.f,
+	 1.f, -1.f, 0.5f, 1.f, 1.f,
+	 1.f,  1.f, 0.5f, 1.f, 0.f
+};
+
+QuadRenderer::QuadRenderer()
+	: prog(0), vertexShader(0), fragmentShader(0), vbo(0), vao(0), posLocation(-1), uvLocation(-1)
+{
+}
+
+static GLuint compileShader(GLenum type, const char* source)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	GLint status;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (status != GL_TRUE)
+	{
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("Error %s shader: %s\n", type == GL_VERTEX_SHADER ? "vertex" : "fragment", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+bool QuadRenderer::init(const char* vertexSource, const char* fragmentSource)
+{
+	release();
+	vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+	fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+	if (!vertexShader || !fragmentShader)
+	{
+		release();
+		return false;
+	}
+	prog = glCreateProgram();
+	glAttachShader(prog, vertexShader);
+	glAttachShader(prog, fragmentShader);
+	glLinkProgram(prog);
+	GLint status;
+	glGetProgramiv(prog, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE)
+	{
+		printf("Unable to link shader\n");
+		release();
+		return false;
+	}
+
+	// locations do not change after linking
+	posLocation = glGetAttribLocation(prog, "pos");
+	uvLocation = glGetAttribLocation(prog, "uv");
+	glUseProgram(prog);
+	glUniform1i(glGetUniformLocation(prog, "tex"), 0);
+	glUseProgram(0);
+
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
+
+	// the vertex array object records the attribute setup once
+	if (glVersionAtLeast(3, 0) || glHasExtension("GL_ARB_vertex_array_object"))
+	{
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		setAttributes();
+		glBindVertexArray(0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR;
+}
+
+void QuadRenderer::release()
+{
+	if (vao)
+		glDeleteVertexArrays(1, &vao);
+	if (vbo)
+		glDeleteBuffers(1, &vbo);
+	if (prog)
+		glDeleteProgram(prog);
+	if (vertexShader)
+		glDeleteShader(vertexShader);
+	if (fragmentShader)
+		glDeleteShader(fragmentShader);
+	vao = vbo = prog = vertexShader = fragmentShader = 0;
+	posLocation = uvLocation = -1;
+}
+
+void QuadRenderer::setAttributes()
+{
+	const GLsizei stride = 5 * sizeof(float);
+	if (posLocation >= 0)
+	{
+		glEnableVertexAttribArray(posLocation);
+		glVertexAttribPointer(posLocation, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(0));
+	}
+	if (uvLocation >= 0)
+	{
+		glEnableVertexAttribArray(uvLocation);
+		glVertexAttribPointer(uvLocation, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(3 * sizeof(float)));
+	}
+}
+
+void QuadRenderer::draw(const GLuint* textures, int numTextures)
+{
+	glUseProgram(prog);
+	for (int i = numTextures - 1; i >= 0; --i)
+	{
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+	}
+	if (vao)
+		glBindVertexArray(vao);
+	else
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		setAttributes();
+	}
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	if (vao)
+		glBindVertexArray(0);
+	else
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,49 @@
+#ifndef QUAD_RENDERER_H
+#define QUAD_RENDERER_H
+
+#include "glutils.h"
+
+// Textured quad covering the viewport, drawn with a program taking attributes pos (vec3) and uv (vec2) and
+// a sampler uniform tex. Compiles and links once, resolves the locations at link time and keeps the vertices in a
+// buffer, recorded in a vertex array object when the context has them, so a frame only binds and draws.
+class QuadRenderer
+{
+public:
+	QuadRenderer();
+
+	QuadRenderer(const QuadRenderer&) = delete;
+	QuadRenderer& operator=(const QuadRenderer&) = delete;
+
+	// Build the program and the quad. Needs a current context.
+	bool init(const char* vertexSource, const char* fragmentSource);
+
+	void release();
+
+	// Draw the texture bound to unit 0
+	void draw(GLuint texture)
+	{
+		draw(&texture, 1);
+	}
+
+	// Draw with textures[i] bound to unit i, for programs sampling several textures
+	void draw(const GLuint* textures, int numTextures);
+
+	GLuint program() const
+	{
+		return prog;
+	}
+
+private:
+	// Point the attributes to the quad buffer
+	void setAttributes();
+
+	GLuint prog;
+	GLuint vertexShader;
+	GLuint fragmentShader;
+	GLuint vbo;
+	GLuint vao;
+	GLint posLocation;
+	GLint uvLocation;
+};
+
+#endif // QUAD_RENDERER_H
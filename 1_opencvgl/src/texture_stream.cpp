@@ -0,0 +1,139 @@
+#include "texture_stream.h"
+
+#include <cstring>
+#include <chrono>
+
+using namespace std;
+
+TextureStream::TextureStream()
+	: tex(0), nextBuffer(0), texWidth(0), texHeight(0), pixelFormat(GL_RGB), pixelType(GL_UNSIGNED_BYTE),
+	rowBytes(0), lastMs(0.), totalMs(0.), numUploads(0)
+{
+}
+
+TextureStream::~TextureStream()
+{
+	// GL objects are only deleted by release, the context may be gone already
+}
+
+bool TextureStream::init(int width, int height, GLenum internalFormat, GLenum format, GLenum type, int numBuffers)
+{
+	release();
+	if (width <= 0 || height <= 0 || numBuffers < 1)
+		return false;
+	texWidth = width;
+	texHeight = height;
+	pixelFormat = format;
+	pixelType = type;
+	rowBytes = width * glPixelSize(format, type);
+	lastMs = totalMs = 0.;
+	numUploads = 0;
+
+	glGenTextures(1, &tex);
+	if (!tex)
+		return false;
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// immutable storage when available, the driver then never has to re-validate the texture
+#ifdef GL_VERSION_4_2
+	if (glVersionAtLeast(4, 2) || glHasExtension("GL_ARB_texture_storage"))
+		glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+	else
+#endif
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+
+	// one frame per pixel buffer, written by the CPU and read once by the GPU
+	buffers.resize(numBuffers);
+	glGenBuffers(numBuffers, buffers.data());
+	for (size_t i = 0; i < buffers.size(); ++i)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[i]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, rowBytes * height, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// fences (OpenGL 3.2) tell when the GPU is done with a buffer
+	if (glVersionAtLeast(3, 2) || glHasExtension("GL_ARB_sync"))
+		fences.assign(buffers.size(), static_cast<GLsync>(0));
+	return glGetError() == GL_NO_ERROR;
+}
+
+void TextureStream::release()
+{
+	for (size_t i = 0; i < fences.size(); ++i)
+	{
+		if (fences[i])
+			glDeleteSync(fences[i]);
+	}
+	fences.clear();
+	if (!buffers.empty())
+		glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+	buffers.clear();
+	if (tex)
+		glDeleteTextures(1, &tex);
+	tex = 0;
+	nextBuffer = 0;
+}
+
+bool TextureStream::upload(const void* data, size_t step)
+{
+	if (!tex)
+		return false;
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	const size_t frameBytes = rowBytes * texHeight;
+
+	// with a fence per buffer the CPU only waits if the GPU still reads the frame uploaded numBuffers ago,
+	// otherwise orphan the previous storage of the buffer
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[nextBuffer]);
+	unsigned char* dst;
+	if (!fences.empty())
+	{
+		if (fences[nextBuffer])
+		{
+			glClientWaitSync(fences[nextBuffer], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(fences[nextBuffer]);
+			fences[nextBuffer] = 0;
+		}
+		dst = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, frameBytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	}
+	else
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, frameBytes, NULL, GL_STREAM_DRAW);
+		dst = static_cast<unsigned char*>(glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY));
+	}
+	if (!dst)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return false;
+	}
+	const unsigned char* src = static_cast<const unsigned char*>(data);
+	if (step == rowBytes)
+		memcpy(dst, src, frameBytes);
+	else
+	{
+		for (int y = 0; y < texHeight; ++y)
+			memcpy(dst + y * rowBytes, src + y * step, rowBytes);
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	// the copy from the buffer to the texture runs asynchronously
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texWidth, texHeight, pixelFormat, pixelType, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!fences.empty())
+		fences[nextBuffer] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	nextBuffer = (nextBuffer + 1) % buffers.size();
+
+	lastMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	totalMs += lastMs;
+	numUploads++;
+	return true;
+}
@@ -0,0 +1,71 @@
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+
+#include "glutils.h"
+#include <vector>
+
+// 2D texture updated every frame from client memory through a ring of pixel unpack buffers.
+// The texture storage is allocated once. Each upload fills the next buffer of the ring, so the CPU copy of
+// frame N+1 does not wait for the GPU to finish reading the buffer of frame N. A fence per buffer protects it
+// from being overwritten before the GPU read it (orphaning is used instead on contexts without sync objects).
+class TextureStream
+{
+public:
+	TextureStream();
+	~TextureStream();
+
+	TextureStream(const TextureStream&) = delete;
+	TextureStream& operator=(const TextureStream&) = delete;
+
+	// Allocate the texture and numBuffers pixel buffers of one frame each. format and type describe the uploaded
+	// pixels (e.g. GL_RGB and GL_UNSIGNED_BYTE for a CV_8UC3 image). Needs a current context.
+	bool init(int width, int height, GLenum internalFormat, GLenum format, GLenum type, int numBuffers = 3);
+
+	// Delete the GL objects. Needs the context of init to be current.
+	void release();
+
+	// Copy a frame of height rows of step bytes into the next pixel buffer and update the texture from it
+	bool upload(const void* data, size_t step);
+
+	GLuint texture() const
+	{
+		return tex;
+	}
+
+	int width() const
+	{
+		return texWidth;
+	}
+
+	int height() const
+	{
+		return texHeight;
+	}
+
+	// CPU time of the last upload and average over all uploads, in milliseconds
+	double lastUploadMs() const
+	{
+		return lastMs;
+	}
+
+	double averageUploadMs() const
+	{
+		return numUploads ? totalMs / numUploads : 0.;
+	}
+
+private:
+	GLuint tex;
+	std::vector<GLuint> buffers;
+	std::vector<GLsync> fences; // per buffer, empty without sync objects
+	size_t nextBuffer;
+	int texWidth;
+	int texHeight;
+	GLenum pixelFormat;
+	GLenum pixelType;
+	size_t rowBytes;
+	double lastMs;
+	double totalMs;
+	size_t numUploads;
+};
+
+#endif // TEXTURE_STREAM_H
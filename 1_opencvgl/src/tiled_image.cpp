@@ -0,0 +1,307 @@
+#include "tiled_image.h"
+
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+// The quad corners (uv from 0 to 1, top left first) are placed on the tile rectangle in normalized device coordinates
+static const char* tileVertexShader = ""
+"attribute vec3 pos;\n"
+"attribute vec2 uv;\n"
+"uniform vec4 rect;\n"
+"uniform vec4 uvRect;\n"
+"varying vec2 tex_uv;\n"
+"\n"
+"void main()\n"
+"{\n"
+"	gl_Position = vec4(mix(rect.xy, rect.zw, uv), 0.5, 1.0);\n"
+"	tex_uv = mix(uvRect.xy, uvRect.zw, uv);\n"
+"}\n";
+
+// Coordinates clamped to the texel centers of the uploaded region, the rest of the texture is not written
+static const char* tileFragmentShader = ""
+"uniform sampler2D tex;\n"
+"uniform vec4 uvClamp;\n"
+"varying vec2 tex_uv;\n"
+"\n"
+"void main()\n"
+"{\n"
+"	gl_FragColor = vec4(texture2D(tex, clamp(tex_uv, uvClamp.xy, uvClamp.zw)).rgb, 1.0);\n"
+"}\n";
+
+TiledImage::TiledImage()
+	: readyLevels(0), stopBuild(false), tileSize(512), maxTiles(0), maxUploadsPerFrame(8), rectLocation(-1),
+	uvRectLocation(-1), uvClampLocation(-1), viewX(0.), viewY(0.), viewZoom(1.), frameIndex(0), frameUploads(0),
+	uploads(0), drawnLevel(0)
+{
+}
+
+TiledImage::~TiledImage()
+{
+	// the GL objects need the context, only the builder thread is stopped here
+	stopBuild = true;
+	if (builder.joinable())
+		builder.join();
+}
+
+bool TiledImage::init(const unsigned char* data, size_t step, int width, int height, int tileSize_, size_t budgetBytes,
+	int maxUploads)
+{
+	release();
+	GLint maxTextureSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	if (tileSize_ + 2 > maxTextureSize)
+	{
+		printf("Tiles of %d pixels larger than the textures (%d)\n", tileSize_, maxTextureSize);
+		return false;
+	}
+	tileSize = tileSize_;
+	maxUploadsPerFrame = max(1, maxUploads);
+
+	// levels down to one tile, allocated before the builder thread starts so they do not move
+	Level level;
+	level.width = width;
+	level.height = height;
+	level.step = step;
+	level.data = data;
+	levels.push_back(level);
+	while (levels.back().width > tileSize || levels.back().height > tileSize)
+	{
+		levels.push_back(Level());
+		Level& half = levels.back();
+		const Level& previous = levels[levels.size() - 2];
+		half.width = (previous.width + 1) / 2;
+		half.height = (previous.height + 1) / 2;
+		half.step = half.width * 3;
+		half.pixels.resize(half.step * half.height);
+	}
+	for (size_t l = 1; l < levels.size(); ++l)
+		levels[l].data = &levels[l].pixels[0];
+
+	// textures of a tile and its border, RGB8 counted as 4 bytes per texel as most drivers store it
+	const int textureSize = tileSize + 2;
+	const size_t tileBytes = static_cast<size_t>(textureSize) * textureSize * 4;
+	maxTiles = max(1, static_cast<int>(budgetBytes / tileBytes));
+	freeTextures.resize(maxTiles);
+	glGenTextures(maxTiles, &freeTextures[0]);
+	for (int i = 0; i < maxTiles; ++i)
+	{
+		glBindTexture(GL_TEXTURE_2D, freeTextures[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, textureSize, textureSize, 0, GL_BGR, GL_UNSIGNED_BYTE, NULL);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (!renderer.init(tileVertexShader, tileFragmentShader))
+	{
+		release();
+		return false;
+	}
+	const GLuint program = renderer.program();
+	rectLocation = glGetUniformLocation(program, "rect");
+	uvRectLocation = glGetUniformLocation(program, "uvRect");
+	uvClampLocation = glGetUniformLocation(program, "uvClamp");
+
+	viewX = width * 0.5;
+	viewY = height * 0.5;
+	viewZoom = 1.;
+	frameIndex = 0;
+	frameUploads = 0;
+	uploads = 0;
+	drawnLevel = 0;
+
+	readyLevels = 1;
+	stopBuild = false;
+	builder = thread(&TiledImage::buildPyramid, this);
+	return glGetError() == GL_NO_ERROR;
+}
+
+void TiledImage::release()
+{
+	stopBuild = true;
+	if (builder.joinable())
+		builder.join();
+	for (list<Tile>::iterator it = cache.begin(); it != cache.end(); ++it)
+		freeTextures.push_back(it->texture);
+	if (!freeTextures.empty())
+		glDeleteTextures(static_cast<GLsizei>(freeTextures.size()), &freeTextures[0]);
+	freeTextures.clear();
+	cache.clear();
+	cacheIndex.clear();
+	renderer.release();
+	levels.clear();
+	readyLevels = 0;
+	maxTiles = 0;
+}
+
+void TiledImage::buildPyramid()
+{
+	for (size_t l = 1; l < levels.size() && !stopBuild; ++l)
+	{
+		// 2x2 box filter, the last row and column are repeated for odd sizes
+		const Level& src = levels[l - 1];
+		Level& dst = levels[l];
+		for (int y = 0; y < dst.height && !stopBuild; ++y)
+		{
+			const unsigned char* row0 = src.data + src.step * (2 * y);
+			const unsigned char* row1 = src.data + src.step * min(2 * y + 1, src.height - 1);
+			unsigned char* out = &dst.pixels[dst.step * y];
+			for (int x = 0; x < dst.width; ++x)
+			{
+				const int c0 = 6 * x;
+				const int c1 = 2 * x + 1 < src.width ? c0 + 3 : c0;
+				for (int c = 0; c < 3; ++c)
+					out[3 * x + c] = static_cast<unsigned char>((row0[c0 + c] + row0[c1 + c] + row1[c0 + c] + row1[c1 + c] + 2) >> 2);
+			}
+		}
+		if (!stopBuild)
+			readyLevels.store(static_cast<int>(l) + 1, memory_order_release);
+	}
+}
+
+void TiledImage::setView(double centerX, double centerY, double zoom)
+{
+	viewX = centerX;
+	viewY = centerY;
+	viewZoom = max(zoom, 1e-6);
+}
+
+double TiledImage::fitZoom(int viewportWidth, int viewportHeight) const
+{
+	if (levels.empty())
+		return 1.;
+	return min(viewportWidth / static_cast<double>(levels[0].width), viewportHeight / static_cast<double>(levels[0].height));
+}
+
+TiledImage::Tile* TiledImage::findTile(int level, int tx, int ty)
+{
+	unordered_map<uint64_t, list<Tile>::iterator>::iterator found = cacheIndex.find(tileKey(level, tx, ty));
+	if (found == cacheIndex.end())
+		return NULL;
+	// most recently used first
+	cache.splice(cache.begin(), cache, found->second);
+	found->second->lastFrame = frameIndex;
+	return &*found->second;
+}
+
+TiledImage::Tile* TiledImage::loadTile(int level, int tx, int ty)
+{
+	GLuint texture;
+	if (!freeTextures.empty())
+	{
+		texture = freeTextures.back();
+		freeTextures.pop_back();
+	}
+	else
+	{
+		// tiles drawn by this frame stay
+		if (cache.empty() || cache.back().lastFrame == frameIndex)
+			return NULL;
+		texture = cache.back().texture;
+		cacheIndex.erase(cache.back().key);
+		cache.pop_back();
+	}
+
+	const Level& src = levels[level];
+	Tile tile;
+	tile.key = tileKey(level, tx, ty);
+	tile.texture = texture;
+	tile.level = level;
+	tile.x0 = max(0, tx * tileSize - 1);
+	tile.y0 = max(0, ty * tileSize - 1);
+	tile.x1 = min(src.width, (tx + 1) * tileSize + 1);
+	tile.y1 = min(src.height, (ty + 1) * tileSize + 1);
+	tile.lastFrame = frameIndex;
+
+	// the region is read in place from the level
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(src.step / 3));
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tile.x1 - tile.x0, tile.y1 - tile.y0, GL_BGR, GL_UNSIGNED_BYTE,
+		src.data + src.step * tile.y0 + 3 * tile.x0);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	cache.push_front(tile);
+	cacheIndex[tile.key] = cache.begin();
+	frameUploads++;
+	uploads++;
+	return &cache.front();
+}
+
+void TiledImage::drawRegion(const Tile& tile, double x0, double y0, double x1, double y1, int level, int viewportWidth,
+	int viewportHeight)
+{
+	// region of the drawn level to full resolution pixels, then to normalized device coordinates
+	const double scale = static_cast<double>(1 << level);
+	const double ndcX = 2. * viewZoom / viewportWidth;
+	const double ndcY = 2. * viewZoom / viewportHeight;
+	glUniform4f(rectLocation,
+		static_cast<float>((x0 * scale - viewX) * ndcX), static_cast<float>(-(y0 * scale - viewY) * ndcY),
+		static_cast<float>((x1 * scale - viewX) * ndcX), static_cast<float>(-(y1 * scale - viewY) * ndcY));
+
+	// the tile may come from a coarser level than the region
+	const double toTile = 1. / (1 << (tile.level - level));
+	const double textureSize = tileSize + 2.;
+	glUniform4f(uvRectLocation,
+		static_cast<float>((x0 * toTile - tile.x0) / textureSize), static_cast<float>((y0 * toTile - tile.y0) / textureSize),
+		static_cast<float>((x1 * toTile - tile.x0) / textureSize), static_cast<float>((y1 * toTile - tile.y0) / textureSize));
+	glUniform4f(uvClampLocation,
+		static_cast<float>(0.5 / textureSize), static_cast<float>(0.5 / textureSize),
+		static_cast<float>((tile.x1 - tile.x0 - 0.5) / textureSize), static_cast<float>((tile.y1 - tile.y0 - 0.5) / textureSize));
+	renderer.draw(tile.texture);
+}
+
+void TiledImage::draw(int viewportWidth, int viewportHeight)
+{
+	if (levels.empty() || viewportWidth <= 0 || viewportHeight <= 0)
+		return;
+	frameIndex++;
+	frameUploads = 0;
+
+	// coarsest level not magnified (a screen pixel covers one to two texels), or the coarsest built so far
+	const int ready = readyLevels.load(memory_order_acquire);
+	int level = 0;
+	while (level + 1 < ready && viewZoom * (2 << level) <= 1.)
+		level++;
+	drawnLevel = level;
+
+	// visible tiles of the level
+	const double scale = static_cast<double>(1 << level);
+	const Level& src = levels[level];
+	const double halfWidth = viewportWidth * 0.5 / viewZoom;
+	const double halfHeight = viewportHeight * 0.5 / viewZoom;
+	const int tx0 = max(0, static_cast<int>(floor((viewX - halfWidth) / scale / tileSize)));
+	const int ty0 = max(0, static_cast<int>(floor((viewY - halfHeight) / scale / tileSize)));
+	const int tx1 = min((src.width - 1) / tileSize, static_cast<int>(floor((viewX + halfWidth) / scale / tileSize)));
+	const int ty1 = min((src.height - 1) / tileSize, static_cast<int>(floor((viewY + halfHeight) / scale / tileSize)));
+
+	glUseProgram(renderer.program());
+	for (int ty = ty0; ty <= ty1; ++ty)
+	{
+		for (int tx = tx0; tx <= tx1; ++tx)
+		{
+			Tile* tile = findTile(level, tx, ty);
+			if (!tile && frameUploads < maxUploadsPerFrame)
+				tile = loadTile(level, tx, ty);
+
+			// until it is uploaded, the region is drawn from the closest coarser tile in the cache
+			for (int coarser = level + 1; !tile && coarser < ready; ++coarser)
+				tile = findTile(coarser, tx >> (coarser - level), ty >> (coarser - level));
+			if (!tile)
+				continue;
+
+			const double x0 = tx * tileSize;
+			const double y0 = ty * tileSize;
+			const double x1 = min((tx + 1) * tileSize, src.width);
+			const double y1 = min((ty + 1) * tileSize, src.height);
+			drawRegion(*tile, x0, y0, x1, y1, level, viewportWidth, viewportHeight);
+		}
+	}
+	glUseProgram(0);
+}
@@ -0,0 +1,160 @@
+#ifndef TILED_IMAGE_H
+#define TILED_IMAGE_H
+
+#include "glutils.h"
+#include "quad_renderer.h"
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+// Pan and zoom over an image larger than GL_MAX_TEXTURE_SIZE (e.g. 100 MP stitched images) with bounded GPU memory.
+// The image is split into square tiles at each level of a pyramid of half resolutions, built on a background thread.
+// A frame only uploads the tiles visible at the level matching the zoom, into a cache of tile textures whose size
+// is set by a memory budget; the least recently drawn tiles are replaced. A tile not uploaded yet is drawn from the
+// resident tile of a coarser level covering it. Tiles hold a one pixel border of their neighbours so linear
+// filtering does not show seams.
+class TiledImage
+{
+public:
+	TiledImage();
+	~TiledImage();
+
+	TiledImage(const TiledImage&) = delete;
+	TiledImage& operator=(const TiledImage&) = delete;
+
+	// BGR image (CV_8UC3) of height rows of step bytes. The pixels are not copied, they must stay valid until release.
+	// At most budgetBytes of tile textures, and maxUploads tiles uploaded per frame to keep the frame time bounded.
+	// Needs a current context.
+	bool init(const unsigned char* data, size_t step, int width, int height, int tileSize = 512,
+		size_t budgetBytes = 256 << 20, int maxUploads = 8);
+
+	// Stop building the pyramid and delete the GL objects. Needs the context of init to be current.
+	void release();
+
+	// Image point (in pixels of the full resolution) shown at the center of the viewport, and screen pixels per
+	// image pixel
+	void setView(double centerX, double centerY, double zoom);
+
+	// Zoom showing the whole image in a viewport
+	double fitZoom(int viewportWidth, int viewportHeight) const;
+
+	// Draw into the current viewport of the given size, uploading the missing visible tiles
+	void draw(int viewportWidth, int viewportHeight);
+
+	int width() const
+	{
+		return levels.empty() ? 0 : levels[0].width;
+	}
+
+	int height() const
+	{
+		return levels.empty() ? 0 : levels[0].height;
+	}
+
+	int numLevels() const
+	{
+		return static_cast<int>(levels.size());
+	}
+
+	// Levels of the pyramid built so far, level 0 being the image itself
+	int numReadyLevels() const
+	{
+		return readyLevels.load();
+	}
+
+	// Tile textures the budget allows and currently holding a tile
+	int capacity() const
+	{
+		return maxTiles;
+	}
+
+	int numResident() const
+	{
+		return static_cast<int>(cache.size());
+	}
+
+	// Tiles uploaded by the last draw and since init
+	int lastUploads() const
+	{
+		return frameUploads;
+	}
+
+	size_t totalUploads() const
+	{
+		return uploads;
+	}
+
+	// Level drawn by the last draw
+	int lastLevel() const
+	{
+		return drawnLevel;
+	}
+
+private:
+	struct Level
+	{
+		int width;
+		int height;
+		size_t step;
+		const unsigned char* data;
+		std::vector<unsigned char> pixels; // owned by the pyramid levels, empty for level 0
+	};
+
+	struct Tile
+	{
+		uint64_t key;
+		GLuint texture;
+		int level;
+		int x0, y0;         // region of the level held by the texture, with the border
+		int x1, y1;
+		unsigned lastFrame; // frame of the last draw using it
+	};
+
+	// Half resolution levels, each from the previous one, until a level fits in one tile
+	void buildPyramid();
+
+	static uint64_t tileKey(int level, int tx, int ty)
+	{
+		return (static_cast<uint64_t>(level) << 48) | (static_cast<uint64_t>(ty) << 24) | static_cast<uint64_t>(tx);
+	}
+
+	// Resident tile, marked as used by this frame, or NULL
+	Tile* findTile(int level, int tx, int ty);
+
+	// Upload a tile into a free or the least recently used texture. NULL if every texture is used by this frame.
+	Tile* loadTile(int level, int tx, int ty);
+
+	// Draw the part [x0, x1) x [y0, y1) of a level (in pixels of that level) from a tile
+	void drawRegion(const Tile& tile, double x0, double y0, double x1, double y1, int level, int viewportWidth,
+		int viewportHeight);
+
+	std::vector<Level> levels;
+	std::atomic<int> readyLevels;
+	std::atomic<bool> stopBuild;
+	std::thread builder;
+
+	int tileSize;
+	int maxTiles;
+	int maxUploadsPerFrame;
+	std::list<Tile> cache; // most recently used first
+	std::unordered_map<uint64_t, std::list<Tile>::iterator> cacheIndex;
+	std::vector<GLuint> freeTextures;
+
+	QuadRenderer renderer;
+	GLint rectLocation;
+	GLint uvRectLocation;
+	GLint uvClampLocation;
+
+	double viewX;
+	double viewY;
+	double viewZoom;
+	unsigned frameIndex;
+	int frameUploads;
+	size_t uploads;
+	int drawnLevel;
+};
+
+#endif // TILED_IMAGE_H
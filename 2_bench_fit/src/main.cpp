@@ -0,0 +1,245 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include "alloc_counter.h"
+#include "boxfit.h"
+#include "random_stacks.h"
+
+using namespace std;
+
+// Timing and counters of a benchmarked function
+struct BenchResult
+{
+	double nsPerCall = 0.;
+	double visitedPerCall = 0.;
+	double allocationsPerCall = 0.;
+};
+
+// Call func on every input, repeating the whole set until minTimeMs is spent
+template<class Func>
+BenchResult runBench(const vector<vector<float> >& inputs, const double minTimeMs, Func func)
+{
+	// warm-up
+	for (size_t i = 0; i < inputs.size(); ++i)
+		func(inputs[i]);
+
+	BenchResult result;
+	size_t numCalls = 0;
+	size_t visited = 0;
+	const size_t allocationsBefore = numAllocations;
+	const auto start = chrono::steady_clock::now();
+	double elapsedMs = 0.;
+	do
+	{
+		for (size_t i = 0; i < inputs.size(); ++i)
+			visited += func(inputs[i]);
+		numCalls += inputs.size();
+		elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	} while (elapsedMs < minTimeMs);
+
+	result.nsPerCall = elapsedMs * 1e6 / numCalls;
+	result.visitedPerCall = static_cast<double>(visited) / numCalls;
+	result.allocationsPerCall = static_cast<double>(numAllocations - allocationsBefore) / numCalls;
+	return result;
+}
+
+static void printResult(const char* name, const int numPlanes, const float noise, const float ratio, const BenchResult& r)
+{
+	printf("%-14s %6d %6.1f %6.1f %14.0f %14.1f %12.2f\n", name, numPlanes, noise, ratio, r.nsPerCall, r.visitedPerCall, r.allocationsPerCall);
+}
+
+// numStacks stacks of numPlanes planes spaced by 1 to 3 boxes of random size in [minSize, maxSize]
+static vector<vector<float> > makeStacks(mt19937& rng, const int numStacks, const int numPlanes, const float noise, const float minSize, const float maxSize)
+{
+	vector<vector<float> > stacks(numStacks);
+	for (int s = 0; s < numStacks; ++s)
+		stacks[s] = makeRandomStack(rng, numPlanes, 1, 3, noise, minSize, maxSize);
+	return stacks;
+}
+
+int main(int argc, char* argv[])
+{
+	// minimum time per configuration in ms
+	const double minTimeMs = argc > 1 ? atof(argv[1]) : 200.;
+	const int numStacks = 16;
+	const float minSize = 150.f;
+	const int planeCounts[] = {3, 5, 7, 9};
+	const float noises[] = {0.f, 5.f, 20.f};
+	const float ratios[] = {1.5f, 2.f, 3.f};
+
+	mt19937 rng(1234);
+	printf("%-14s %6s %6s %6s %14s %14s %12s\n", "function", "planes", "noise", "ratio", "ns/call", "visited/call", "allocs/call");
+	for (size_t p = 0; p < sizeof(planeCounts) / sizeof(planeCounts[0]); ++p)
+	{
+		for (size_t n = 0; n < sizeof(noises) / sizeof(noises[0]); ++n)
+		{
+			for (size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); ++r)
+			{
+				const int numPlanes = planeCounts[p];
+				const float maxSize = minSize * ratios[r];
+				const vector<vector<float> > stacks = makeStacks(rng, numStacks, numPlanes, noises[n], minSize, maxSize);
+
+				float boxSize;
+				vector<int> bestHypothesis;
+				const BenchResult fit = runBench(stacks, minTimeMs, [&](const vector<float>& sizes)
+				{
+					fitBoxSize(boxSize, bestHypothesis, minSize, maxSize, sizes);
+					return lastFitVisitedHypotheses();
+				});
+				printResult("fitBoxSize", numPlanes, noises[n], ratios[r], fit);
+
+				const BenchResult bnb = runBench(stacks, minTimeMs, [&](const vector<float>& sizes)
+				{
+					fitBoxSizeBnB(boxSize, bestHypothesis, minSize, maxSize, sizes);
+					return lastFitVisitedHypotheses();
+				});
+				printResult("fitBoxSizeBnB", numPlanes, noises[n], ratios[r], bnb);
+
+				const BenchResult sweep = runBench(stacks, minTimeMs, [&](const vector<float>& sizes)
+				{
+					fitBoxSizeSweep(boxSize, bestHypothesis, minSize, maxSize, sizes);
+					return lastFitVisitedHypotheses();
+				});
+				printResult("fitBoxSizeSweep", numPlanes, noises[n], ratios[r], sweep);
+
+				// without a budget, to compare the nearest first order
+				const BenchResult anytime = runBench(stacks, minTimeMs, [&](const vector<float>& sizes)
+				{
+					return fitBoxSizeAnytime(boxSize, bestHypothesis, minSize, maxSize, sizes, 0).numVisited;
+				});
+				printResult("fitBoxSizeAny", numPlanes, noises[n], ratios[r], anytime);
+
+				// one size, then a second taller size that some gaps also fit, to compare the cost of the second one
+				MultiBoxFit multiFit;
+				vector<BoxSizeRange> ranges(1);
+				ranges[0].minSize = minSize;
+				ranges[0].maxSize = maxSize;
+				const BenchResult multi1 = runBench(stacks, minTimeMs, [&](const vector<float>& sizes)
+				{
+					fitBoxSizes(multiFit, ranges, sizes);
+					return lastFitVisitedHypotheses();
+				});
+				printResult("fitBoxSizesK1", numPlanes, noises[n], ratios[r], multi1);
+
+				ranges.push_back(ranges[0]);
+				ranges[1].minSize = 1.3f * maxSize;
+				ranges[1].maxSize = 1.4f * maxSize;
+				const BenchResult multi2 = runBench(stacks, minTimeMs, [&](const vector<float>& sizes)
+				{
+					fitBoxSizes(multiFit, ranges, sizes);
+					return lastFitVisitedHypotheses();
+				});
+				printResult("fitBoxSizesK2", numPlanes, noises[n], ratios[r], multi2);
+
+				// fitBoxSize2 only supports up to 10 steps
+				bool validSteps = true;
+				for (size_t s = 0; s < stacks.size(); ++s)
+					validSteps = validSteps && (stacks[s].back() - stacks[s].front()) / minSize <= 10.f;
+				if (validSteps)
+				{
+					const BenchResult fit2 = runBench(stacks, minTimeMs, [&](const vector<float>& sizes)
+					{
+						fitBoxSize2(boxSize, bestHypothesis, minSize, maxSize, sizes);
+						return lastFitVisitedHypotheses();
+					});
+					printResult("fitBoxSize2", numPlanes, noises[n], ratios[r], fit2);
+				}
+			}
+		}
+	}
+
+	// parallel fitters against fitBoxSize on stacks with many hypotheses, for pools up to one thread per core
+	printf("\n%-18s %8s %14s %12s\n", "function", "threads", "ns/stack", "allocs/stack");
+	const vector<vector<float> > parallelStacks = makeStacks(rng, numStacks, 9, 5.f, minSize, 2.f * minSize);
+	vector<BoxFitInput> batchInputs(parallelStacks.size());
+	for (size_t s = 0; s < parallelStacks.size(); ++s)
+	{
+		batchInputs[s].sizes = parallelStacks[s];
+		batchInputs[s].minSize = minSize;
+		batchInputs[s].maxSize = 2.f * minSize;
+	}
+	float boxSize;
+	vector<int> bestHypothesis;
+	const BenchResult serial = runBench(parallelStacks, minTimeMs, [&](const vector<float>& sizes)
+	{
+		fitBoxSize(boxSize, bestHypothesis, minSize, 2.f * minSize, sizes);
+		return size_t(0);
+	});
+	printf("%-18s %8u %14.0f %12.2f\n", "fitBoxSize", 1u, serial.nsPerCall, serial.allocationsPerCall);
+	const unsigned numCores = max(1u, thread::hardware_concurrency());
+	for (unsigned numThreads = 1;; numThreads = min(2 * numThreads, numCores))
+	{
+		ThreadPool pool(numThreads);
+		const BenchResult parallel = runBench(parallelStacks, minTimeMs, [&](const vector<float>& sizes)
+		{
+			fitBoxSizeParallel(boxSize, bestHypothesis, minSize, 2.f * minSize, sizes, pool);
+			return size_t(0);
+		});
+		printf("%-18s %8u %14.0f %12.2f\n", "fitBoxSizeParallel", numThreads, parallel.nsPerCall, parallel.allocationsPerCall);
+
+		// the whole batch per call
+		vector<BoxFitResult> results;
+		const BenchResult batch = runBench(vector<vector<float> >(1), minTimeMs, [&](const vector<float>&)
+		{
+			fitBoxSizeBatch(results, batchInputs, pool);
+			return size_t(0);
+		});
+		printf("%-18s %8u %14.0f %12.2f\n", "fitBoxSizeBatch", numThreads, batch.nsPerCall / batchInputs.size(),
+			batch.allocationsPerCall / batchInputs.size());
+		if (numThreads == numCores)
+			break;
+	}
+
+	// nearest depth queries against lists of growing size
+	printf("\n%-18s %8s %14s %12s\n", "function", "size", "ns/call", "allocs/call");
+	const int listSizes[] = {8, 64, 512};
+	for (size_t l = 0; l < sizeof(listSizes) / sizeof(listSizes[0]); ++l)
+	{
+		uniform_real_distribution<float> depthDist(500.f, 4000.f);
+		vector<float> list(listSizes[l]);
+		for (size_t i = 0; i < list.size(); ++i)
+			list[i] = depthDist(rng);
+		vector<vector<float> > queries(256, vector<float>(1));
+		for (size_t q = 0; q < queries.size(); ++q)
+			queries[q][0] = depthDist(rng);
+
+		float sum = 0.f;
+		const BenchResult closest = runBench(queries, minTimeMs, [&](const vector<float>& query)
+		{
+			sum += getClosestElement(list, query[0]);
+			return size_t(0);
+		});
+		printf("%-18s %8d %14.0f %12.2f\n", "getClosestElement", listSizes[l], closest.nsPerCall, closest.allocationsPerCall);
+
+		const ClosestValueIndex<float> index(list);
+		const BenchResult indexed = runBench(queries, minTimeMs, [&](const vector<float>& query)
+		{
+			sum += index.closest(query[0]);
+			return size_t(0);
+		});
+		printf("%-18s %8d %14.0f %12.2f\n", "ClosestValueIndex", listSizes[l], indexed.nsPerCall, indexed.allocationsPerCall);
+
+		vector<float> sortedQueries(queries.size());
+		for (size_t q = 0; q < queries.size(); ++q)
+			sortedQueries[q] = queries[q][0];
+		sort(sortedQueries.begin(), sortedQueries.end());
+		vector<float> values;
+		const vector<vector<float> > batches(1, sortedQueries);
+		const BenchResult batched = runBench(batches, minTimeMs, [&](const vector<float>& batch)
+		{
+			index.closest(values, batch);
+			sum += values[0];
+			return size_t(0);
+		});
+		printf("%-18s %8d %14.0f %12.2f\n", "  batch, per query", listSizes[l], batched.nsPerCall / sortedQueries.size(),
+			batched.allocationsPerCall / sortedQueries.size());
+		if (sum == 0.f)
+			printf("\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,176 @@
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <cstdint>
+
+// Lock-free queue of frames between one producer thread (capture, decode) and one consumer thread (render) where the
+// newest frame wins. Pushing never blocks: when depth frames are already waiting, the oldest one is dropped.
+// The consumer takes the newest waiting frame and drops the older ones, so a slow producer or consumer adds at most
+// one frame of latency. T must be default constructible and movable (e.g. cv::Mat, moved without copying pixels).
+template<class T>
+class LatestFrameQueue
+{
+public:
+	// depth: frames kept waiting for the consumer. lateMs: age above which a taken frame counts as late.
+	explicit LatestFrameQueue(const int depth = 1, const double lateMs = 50.)
+		: slots(depth + 2), maxQueued(depth), lateAge(lateMs), nextSequence(1), pushed(0), dropped(0), taken(0), late(0)
+	{
+		for (size_t i = 0; i < slots.size(); ++i)
+		{
+			slots[i].state.store(FREE);
+			slots[i].sequence.store(0);
+		}
+	}
+
+	LatestFrameQueue(const LatestFrameQueue&) = delete;
+	LatestFrameQueue& operator=(const LatestFrameQueue&) = delete;
+
+	// Producer: queue a frame, dropping the oldest waiting one if the queue is full
+	void push(T&& frame)
+	{
+		// with depth + 2 slots, one may be read by the consumer and depth be waiting: one is always free or droppable
+		Slot* target = NULL;
+		for (;;)
+		{
+			int numReady = 0;
+			Slot* oldest = NULL;
+			for (size_t i = 0; i < slots.size(); ++i)
+			{
+				const int state = slots[i].state.load(std::memory_order_acquire);
+				if (state == FREE && !target)
+					target = &slots[i];
+				else if (state == READY)
+				{
+					numReady++;
+					if (!oldest || slots[i].sequence.load(std::memory_order_relaxed) < oldest->sequence.load(std::memory_order_relaxed))
+						oldest = &slots[i];
+				}
+			}
+			if (numReady < maxQueued && target)
+				break;
+
+			// drop the oldest waiting frame, unless the consumer just took it
+			int expected = READY;
+			if (oldest && oldest->state.compare_exchange_strong(expected, WRITING, std::memory_order_acquire))
+			{
+				dropped++;
+				if (!target)
+				{
+					target = oldest;
+					break;
+				}
+				oldest->state.store(FREE, std::memory_order_release);
+			}
+		}
+
+		// a free slot is only written by the producer
+		target->state.store(WRITING, std::memory_order_relaxed);
+		target->frame = std::move(frame);
+		target->sequence.store(nextSequence++, std::memory_order_relaxed);
+		target->pushTime = std::chrono::steady_clock::now();
+		target->state.store(READY, std::memory_order_release);
+		pushed++;
+	}
+
+	// Consumer: take the newest frame and drop the older waiting ones. Returns false if no frame is waiting.
+	// ageMs receives the time the frame waited in the queue.
+	bool popLatest(T& frame, double* ageMs = NULL)
+	{
+		for (;;)
+		{
+			Slot* newest = NULL;
+			for (size_t i = 0; i < slots.size(); ++i)
+			{
+				if (slots[i].state.load(std::memory_order_acquire) == READY && 
+					(!newest || slots[i].sequence.load(std::memory_order_relaxed) > newest->sequence.load(std::memory_order_relaxed)))
+					newest = &slots[i];
+			}
+			if (!newest)
+				return false;
+
+			// the producer may be dropping it, then look again
+			int expected = READY;
+			if (!newest->state.compare_exchange_strong(expected, READING, std::memory_order_acquire))
+				continue;
+			const uint64_t sequence = newest->sequence.load(std::memory_order_relaxed);
+			frame = std::move(newest->frame);
+			const double age = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - newest->pushTime).count();
+			newest->state.store(FREE, std::memory_order_release);
+
+			// older frames would only add latency. The sequence is only stable once the slot is held: read before,
+			// it may be the one of a frame freed since then, and the producer may have written a newer frame there.
+			for (size_t i = 0; i < slots.size(); ++i)
+			{
+				expected = READY;
+				if (!slots[i].state.compare_exchange_strong(expected, READING, std::memory_order_acquire))
+					continue;
+				if (slots[i].sequence.load(std::memory_order_relaxed) < sequence)
+				{
+					slots[i].state.store(FREE, std::memory_order_release);
+					dropped++;
+				}
+				else
+					slots[i].state.store(READY, std::memory_order_release);
+			}
+			taken++;
+			if (age > lateAge)
+				late++;
+			if (ageMs)
+				*ageMs = age;
+			return true;
+		}
+	}
+
+	// Frames pushed, dropped without being taken, taken, and taken later than lateMs after their push
+	size_t numPushed() const
+	{
+		return pushed.load();
+	}
+
+	size_t numDropped() const
+	{
+		return dropped.load();
+	}
+
+	size_t numTaken() const
+	{
+		return taken.load();
+	}
+
+	size_t numLate() const
+	{
+		return late.load();
+	}
+
+private:
+	enum State
+	{
+		FREE,
+		WRITING,
+		READY,
+		READING
+	};
+
+	struct Slot
+	{
+		std::atomic<int> state;
+		std::atomic<uint64_t> sequence; // order of the pushes, read while scanning for the oldest and newest
+		std::chrono::steady_clock::time_point pushTime;
+		T frame;
+	};
+
+	std::vector<Slot> slots;
+	const int maxQueued;
+	const double lateAge;
+	uint64_t nextSequence; // producer only
+	std::atomic<size_t> pushed;
+	std::atomic<size_t> dropped;
+	std::atomic<size_t> taken;
+	std::atomic<size_t> late;
+};
+
+#endif // FRAME_QUEUE_H
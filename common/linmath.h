@@ -7,6 +7,17 @@
 #define inline __inline
 #endif
 
+/* SSE (x86 baseline) or NEON versions of the matrix and quaternion products, define LINMATH_NO_SIMD for the scalar code */
+#if !defined(LINMATH_NO_SIMD)
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LINMATH_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LINMATH_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
 #define LINMATH_H_DEFINE_VEC(n) \
 typedef float vec##n[n]; \
 static inline void vec##n##_add(vec##n r, vec##n const a, vec##n const b) \
@@ -144,6 +155,25 @@ static inline void mat4x4_scale_aniso(mat4x4 M, mat4x4 a, float x, float y, floa
 }
 static inline void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b)
 {
+#if defined(LINMATH_SSE)
+	/* column c of the product is a combination of the columns of a, all loaded before M is written */
+	__m128 a0 = _mm_loadu_ps(a[0]), a1 = _mm_loadu_ps(a[1]), a2 = _mm_loadu_ps(a[2]), a3 = _mm_loadu_ps(a[3]);
+	__m128 temp[4];
+	int c;
+	for(c=0; c<4; ++c)
+		temp[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(b[c][0])), _mm_mul_ps(a1, _mm_set1_ps(b[c][1]))),
+			_mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(b[c][2])), _mm_mul_ps(a3, _mm_set1_ps(b[c][3]))));
+	for(c=0; c<4; ++c)
+		_mm_storeu_ps(M[c], temp[c]);
+#elif defined(LINMATH_NEON)
+	float32x4_t a0 = vld1q_f32(a[0]), a1 = vld1q_f32(a[1]), a2 = vld1q_f32(a[2]), a3 = vld1q_f32(a[3]);
+	float32x4_t temp[4];
+	int c;
+	for(c=0; c<4; ++c)
+		temp[c] = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(a0, b[c][0]), a1, b[c][1]), a2, b[c][2]), a3, b[c][3]);
+	for(c=0; c<4; ++c)
+		vst1q_f32(M[c], temp[c]);
+#else
 	mat4x4 temp;
 	int k, r, c;
 	for(c=0; c<4; ++c) for(r=0; r<4; ++r) {
@@ -152,15 +182,26 @@ static inline void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b)
 			temp[c][r] += a[k][r] * b[c][k];
 	}
 	mat4x4_dup(M, temp);
+#endif
 }
 static inline void mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v)
 {
+#if defined(LINMATH_SSE)
+	__m128 x = _mm_set1_ps(v[0]), y = _mm_set1_ps(v[1]), z = _mm_set1_ps(v[2]), w = _mm_set1_ps(v[3]);
+	_mm_storeu_ps(r, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(M[0]), x), _mm_mul_ps(_mm_loadu_ps(M[1]), y)),
+		_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(M[2]), z), _mm_mul_ps(_mm_loadu_ps(M[3]), w))));
+#elif defined(LINMATH_NEON)
+	float x = v[0], y = v[1], z = v[2], w = v[3];
+	vst1q_f32(r, vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(vld1q_f32(M[0]), x), vld1q_f32(M[1]), y),
+		vld1q_f32(M[2]), z), vld1q_f32(M[3]), w));
+#else
 	int i, j;
 	for(j=0; j<4; ++j) {
 		r[j] = 0.f;
 		for(i=0; i<4; ++i)
 			r[j] += M[i][j] * v[i];
 	}
+#endif
 }
 static inline void mat4x4_translate(mat4x4 T, float x, float y, float z)
 {
@@ -278,6 +319,48 @@ static inline void mat4x4_invert(mat4x4 T, mat4x4 M)
 	/* Assumes it is invertible */
 	idet = 1.0f/( s[0]*c[5]-s[1]*c[4]+s[2]*c[3]+s[3]*c[2]-s[4]*c[1]+s[5]*c[0] );
 
+#if defined(LINMATH_SSE) || defined(LINMATH_NEON)
+	{
+	/* Each column of T combines the rows of M taken from the columns 1, 0, 3, 2 (p[k]) with the
+	 * cofactors c for its first half and s for its second half (f[k]), with alternate signs. */
+	const float p[4][4] = {
+		{ M[1][0], M[0][0], M[3][0], M[2][0] },
+		{ M[1][1], M[0][1], M[3][1], M[2][1] },
+		{ M[1][2], M[0][2], M[3][2], M[2][2] },
+		{ M[1][3], M[0][3], M[3][3], M[2][3] }
+	};
+	const float f[6][4] = {
+		{ c[0], c[0], s[0], s[0] },
+		{ c[1], c[1], s[1], s[1] },
+		{ c[2], c[2], s[2], s[2] },
+		{ c[3], c[3], s[3], s[3] },
+		{ c[4], c[4], s[4], s[4] },
+		{ c[5], c[5], s[5], s[5] }
+	};
+	const float sign[4] = { idet, -idet, idet, -idet };
+#if defined(LINMATH_SSE)
+	__m128 p0 = _mm_loadu_ps(p[0]), p1 = _mm_loadu_ps(p[1]), p2 = _mm_loadu_ps(p[2]), p3 = _mm_loadu_ps(p[3]);
+	__m128 f0 = _mm_loadu_ps(f[0]), f1 = _mm_loadu_ps(f[1]), f2 = _mm_loadu_ps(f[2]);
+	__m128 f3 = _mm_loadu_ps(f[3]), f4 = _mm_loadu_ps(f[4]), f5 = _mm_loadu_ps(f[5]);
+	__m128 k = _mm_loadu_ps(sign);
+	__m128 nk = _mm_sub_ps(_mm_setzero_ps(), k);
+	_mm_storeu_ps(T[0], _mm_mul_ps(k, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(p1, f5), _mm_mul_ps(p2, f4)), _mm_mul_ps(p3, f3))));
+	_mm_storeu_ps(T[1], _mm_mul_ps(nk, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(p0, f5), _mm_mul_ps(p2, f2)), _mm_mul_ps(p3, f1))));
+	_mm_storeu_ps(T[2], _mm_mul_ps(k, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(p0, f4), _mm_mul_ps(p1, f2)), _mm_mul_ps(p3, f0))));
+	_mm_storeu_ps(T[3], _mm_mul_ps(nk, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(p0, f3), _mm_mul_ps(p1, f1)), _mm_mul_ps(p2, f0))));
+#else
+	float32x4_t p0 = vld1q_f32(p[0]), p1 = vld1q_f32(p[1]), p2 = vld1q_f32(p[2]), p3 = vld1q_f32(p[3]);
+	float32x4_t f0 = vld1q_f32(f[0]), f1 = vld1q_f32(f[1]), f2 = vld1q_f32(f[2]);
+	float32x4_t f3 = vld1q_f32(f[3]), f4 = vld1q_f32(f[4]), f5 = vld1q_f32(f[5]);
+	float32x4_t k = vld1q_f32(sign);
+	float32x4_t nk = vnegq_f32(k);
+	vst1q_f32(T[0], vmulq_f32(k, vmlaq_f32(vmlsq_f32(vmulq_f32(p1, f5), p2, f4), p3, f3)));
+	vst1q_f32(T[1], vmulq_f32(nk, vmlaq_f32(vmlsq_f32(vmulq_f32(p0, f5), p2, f2), p3, f1)));
+	vst1q_f32(T[2], vmulq_f32(k, vmlaq_f32(vmlsq_f32(vmulq_f32(p0, f4), p1, f2), p3, f0)));
+	vst1q_f32(T[3], vmulq_f32(nk, vmlaq_f32(vmlsq_f32(vmulq_f32(p0, f3), p1, f1), p2, f0)));
+#endif
+	}
+#else
 	T[0][0] = ( M[1][1] * c[5] - M[1][2] * c[4] + M[1][3] * c[3]) * idet;
 	T[0][1] = (-M[0][1] * c[5] + M[0][2] * c[4] - M[0][3] * c[3]) * idet;
 	T[0][2] = ( M[3][1] * s[5] - M[3][2] * s[4] + M[3][3] * s[3]) * idet;
@@ -297,6 +380,7 @@ static inline void mat4x4_invert(mat4x4 T, mat4x4 M)
 	T[3][1] = ( M[0][0] * c[3] - M[0][1] * c[1] + M[0][2] * c[0]) * idet;
 	T[3][2] = (-M[3][0] * s[3] + M[3][1] * s[1] - M[3][2] * s[0]) * idet;
 	T[3][3] = ( M[2][0] * s[3] - M[2][1] * s[1] + M[2][2] * s[0]) * idet;
+#endif
 }
 static inline void mat4x4_orthonormalize(mat4x4 R, mat4x4 M)
 {
@@ -443,6 +527,21 @@ static inline void quat_sub(quat r, quat a, quat b)
 }
 static inline void quat_mul(quat r, quat p, quat q)
 {
+#if defined(LINMATH_SSE) || defined(LINMATH_NEON)
+	/* r = p.w * q + p.x * (q.w, -q.z, q.y, -q.x) + p.y * (q.z, q.w, -q.x, -q.y) + p.z * (-q.y, q.x, q.w, -q.z) */
+	const float qx[4] = {  q[3], -q[2],  q[1], -q[0] };
+	const float qy[4] = {  q[2],  q[3], -q[0], -q[1] };
+	const float qz[4] = { -q[1],  q[0],  q[3], -q[2] };
+#if defined(LINMATH_SSE)
+	__m128 px = _mm_set1_ps(p[0]), py = _mm_set1_ps(p[1]), pz = _mm_set1_ps(p[2]), pw = _mm_set1_ps(p[3]);
+	_mm_storeu_ps(r, _mm_add_ps(_mm_add_ps(_mm_mul_ps(pw, _mm_loadu_ps(q)), _mm_mul_ps(px, _mm_loadu_ps(qx))),
+		_mm_add_ps(_mm_mul_ps(py, _mm_loadu_ps(qy)), _mm_mul_ps(pz, _mm_loadu_ps(qz)))));
+#else
+	float px = p[0], py = p[1], pz = p[2], pw = p[3];
+	vst1q_f32(r, vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(vld1q_f32(q), pw), vld1q_f32(qx), px),
+		vld1q_f32(qy), py), vld1q_f32(qz), pz));
+#endif
+#else
 	vec3 w;
 	vec3_mul_cross(r, p, q);
 	vec3_scale(w, p, q[3]);
@@ -450,6 +549,7 @@ static inline void quat_mul(quat r, quat p, quat q)
 	vec3_scale(w, q, p[3]);
 	vec3_add(r, r, w);
 	r[3] = p[3]*q[3] - vec3_mul_inner(p, q);
+#endif
 }
 static inline void quat_scale(quat r, quat v, float s)
 {
@@ -0,0 +1,250 @@
+#include "linmath_batch.h"
+
+#if defined(LINMATH_SSE)
+#define BATCH_X86
+#include "cpu_features.h"
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Scalar tails of the batches
+static void transformScalar(float* rx, float* ry, float* rz, mat4x4 M, const float* x, const float* y, const float* z,
+	const size_t begin, const size_t n)
+{
+	for (size_t i = begin; i < n; ++i)
+	{
+		const float px = x[i], py = y[i], pz = z[i];
+		rx[i] = M[0][0] * px + M[1][0] * py + M[2][0] * pz + M[3][0];
+		ry[i] = M[0][1] * px + M[1][1] * py + M[2][1] * pz + M[3][1];
+		rz[i] = M[0][2] * px + M[1][2] * py + M[2][2] * pz + M[3][2];
+	}
+}
+
+static void mulVec4Scalar(vec4* r, mat4x4 M, const vec4* v, const size_t begin, const size_t n)
+{
+	for (size_t i = begin; i < n; ++i)
+	{
+		vec4 p = { v[i][0], v[i][1], v[i][2], v[i][3] };
+		mat4x4_mul_vec4(r[i], M, p);
+	}
+}
+
+#if defined(BATCH_X86)
+
+// Coefficients of the affine rows broadcast to all lanes: row r is m[4 * r] * x + m[4 * r + 1] * y + m[4 * r + 2] * z + m[4 * r + 3]
+struct AffineSse
+{
+	__m128 m[12];
+
+	explicit AffineSse(mat4x4 M)
+	{
+		for (int r = 0; r < 3; ++r)
+			for (int k = 0; k < 4; ++k)
+				m[4 * r + k] = _mm_set1_ps(M[k][r]);
+	}
+};
+
+static inline __m128 affineRow(const __m128* m, const __m128 x, const __m128 y, const __m128 z)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], x), _mm_mul_ps(m[1], y)), _mm_add_ps(_mm_mul_ps(m[2], z), m[3]));
+}
+
+// 4 points, all loaded before the outputs are written
+static inline void transform4Sse(float* rx, float* ry, float* rz, const AffineSse& a, const float* x, const float* y,
+	const float* z)
+{
+	const __m128 px = _mm_loadu_ps(x), py = _mm_loadu_ps(y), pz = _mm_loadu_ps(z);
+	_mm_storeu_ps(rx, affineRow(a.m, px, py, pz));
+	_mm_storeu_ps(ry, affineRow(a.m + 4, px, py, pz));
+	_mm_storeu_ps(rz, affineRow(a.m + 8, px, py, pz));
+}
+
+static void transformSoaSse(float* rx, float* ry, float* rz, mat4x4 M, const float* x, const float* y, const float* z,
+	const size_t n)
+{
+	const AffineSse a(M);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		transform4Sse(rx + i, ry + i, rz + i, a, x + i, y + i, z + i);
+	transformScalar(rx, ry, rz, M, x, y, z, i, n);
+}
+
+static void transformAosoaSse(float* r, mat4x4 M, const float* v, const size_t numBlocks)
+{
+	const AffineSse a(M);
+	for (size_t b = 0; b < numBlocks; ++b, v += 3 * LINMATH_BLOCK, r += 3 * LINMATH_BLOCK)
+	{
+		for (int half = 0; half < LINMATH_BLOCK; half += 4)
+			transform4Sse(r + half, r + LINMATH_BLOCK + half, r + 2 * LINMATH_BLOCK + half, a, v + half,
+				v + LINMATH_BLOCK + half, v + 2 * LINMATH_BLOCK + half);
+	}
+}
+
+static void mulVec4Sse(vec4* r, mat4x4 M, const vec4* v, const size_t n)
+{
+	const __m128 c0 = _mm_loadu_ps(M[0]), c1 = _mm_loadu_ps(M[1]), c2 = _mm_loadu_ps(M[2]), c3 = _mm_loadu_ps(M[3]);
+	for (size_t i = 0; i < n; ++i)
+	{
+		const __m128 p = _mm_loadu_ps(v[i]);
+		_mm_storeu_ps(r[i], _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0))), _mm_mul_ps(c1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1)))),
+			_mm_add_ps(_mm_mul_ps(c2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))), _mm_mul_ps(c3, _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3))))));
+	}
+}
+
+TARGET_AVX2 static inline __m256 affineRowAvx2(const __m256* m, const __m256 x, const __m256 y, const __m256 z)
+{
+	return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], x), _mm256_mul_ps(m[1], y)), _mm256_add_ps(_mm256_mul_ps(m[2], z), m[3]));
+}
+
+TARGET_AVX2 static inline void setAffineAvx2(__m256* m, mat4x4 M)
+{
+	for (int r = 0; r < 3; ++r)
+		for (int k = 0; k < 4; ++k)
+			m[4 * r + k] = _mm256_set1_ps(M[k][r]);
+}
+
+TARGET_AVX2 static inline void transform8Avx2(float* rx, float* ry, float* rz, const __m256* m, const float* x,
+	const float* y, const float* z)
+{
+	const __m256 px = _mm256_loadu_ps(x), py = _mm256_loadu_ps(y), pz = _mm256_loadu_ps(z);
+	_mm256_storeu_ps(rx, affineRowAvx2(m, px, py, pz));
+	_mm256_storeu_ps(ry, affineRowAvx2(m + 4, px, py, pz));
+	_mm256_storeu_ps(rz, affineRowAvx2(m + 8, px, py, pz));
+}
+
+TARGET_AVX2 static void transformSoaAvx2(float* rx, float* ry, float* rz, mat4x4 M, const float* x, const float* y,
+	const float* z, const size_t n)
+{
+	__m256 m[12];
+	setAffineAvx2(m, M);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		transform8Avx2(rx + i, ry + i, rz + i, m, x + i, y + i, z + i);
+	transformScalar(rx, ry, rz, M, x, y, z, i, n);
+}
+
+TARGET_AVX2 static void transformAosoaAvx2(float* r, mat4x4 M, const float* v, const size_t numBlocks)
+{
+	__m256 m[12];
+	setAffineAvx2(m, M);
+	for (size_t b = 0; b < numBlocks; ++b, v += 3 * LINMATH_BLOCK, r += 3 * LINMATH_BLOCK)
+		transform8Avx2(r, r + LINMATH_BLOCK, r + 2 * LINMATH_BLOCK, m, v, v + LINMATH_BLOCK, v + 2 * LINMATH_BLOCK);
+}
+
+// Two vectors per register, the columns repeated in both halves
+TARGET_AVX2 static void mulVec4Avx2(vec4* r, mat4x4 M, const vec4* v, const size_t n)
+{
+	const __m256 c0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(M[0]));
+	const __m256 c1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(M[1]));
+	const __m256 c2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(M[2]));
+	const __m256 c3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(M[3]));
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2)
+	{
+		const __m256 p = _mm256_loadu_ps(v[i]);
+		_mm256_storeu_ps(r[i], _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(c0, _mm256_permute_ps(p, 0x00)), _mm256_mul_ps(c1, _mm256_permute_ps(p, 0x55))),
+			_mm256_add_ps(_mm256_mul_ps(c2, _mm256_permute_ps(p, 0xAA)), _mm256_mul_ps(c3, _mm256_permute_ps(p, 0xFF)))));
+	}
+	mulVec4Scalar(r, M, v, i, n);
+}
+
+// CPUID runs on the first batch, not during static initialization
+static bool useAvx2()
+{
+	static const bool supported = cpuHasAvx2();
+	return supported;
+}
+
+void mat4x4_mul_vec4_batch(vec4* r, mat4x4 M, const vec4* v, size_t n)
+{
+	if (useAvx2())
+		mulVec4Avx2(r, M, v, n);
+	else
+		mulVec4Sse(r, M, v, n);
+}
+
+void mat4x4_transform_soa(float* rx, float* ry, float* rz, mat4x4 M, const float* x, const float* y, const float* z,
+	size_t n)
+{
+	if (useAvx2())
+		transformSoaAvx2(rx, ry, rz, M, x, y, z, n);
+	else
+		transformSoaSse(rx, ry, rz, M, x, y, z, n);
+}
+
+void mat4x4_transform_aosoa(float* r, mat4x4 M, const float* v, size_t numBlocks)
+{
+	if (useAvx2())
+		transformAosoaAvx2(r, M, v, numBlocks);
+	else
+		transformAosoaSse(r, M, v, numBlocks);
+}
+
+#elif defined(LINMATH_NEON)
+
+// 4 points, all loaded before the outputs are written
+static inline void transform4Neon(float* rx, float* ry, float* rz, mat4x4 M, const float* x, const float* y,
+	const float* z)
+{
+	const float32x4_t px = vld1q_f32(x), py = vld1q_f32(y), pz = vld1q_f32(z);
+	float32x4_t row[3];
+	for (int r = 0; r < 3; ++r)
+		row[r] = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(M[3][r]), px, M[0][r]), py, M[1][r]), pz, M[2][r]);
+	vst1q_f32(rx, row[0]);
+	vst1q_f32(ry, row[1]);
+	vst1q_f32(rz, row[2]);
+}
+
+void mat4x4_mul_vec4_batch(vec4* r, mat4x4 M, const vec4* v, size_t n)
+{
+	const float32x4_t c0 = vld1q_f32(M[0]), c1 = vld1q_f32(M[1]), c2 = vld1q_f32(M[2]), c3 = vld1q_f32(M[3]);
+	for (size_t i = 0; i < n; ++i)
+	{
+		const float32x4_t p = vld1q_f32(v[i]);
+		vst1q_f32(r[i], vmlaq_lane_f32(vmlaq_lane_f32(vmlaq_lane_f32(vmulq_lane_f32(c0, vget_low_f32(p), 0),
+			c1, vget_low_f32(p), 1), c2, vget_high_f32(p), 0), c3, vget_high_f32(p), 1));
+	}
+}
+
+void mat4x4_transform_soa(float* rx, float* ry, float* rz, mat4x4 M, const float* x, const float* y, const float* z,
+	size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		transform4Neon(rx + i, ry + i, rz + i, M, x + i, y + i, z + i);
+	transformScalar(rx, ry, rz, M, x, y, z, i, n);
+}
+
+void mat4x4_transform_aosoa(float* r, mat4x4 M, const float* v, size_t numBlocks)
+{
+	for (size_t b = 0; b < numBlocks; ++b, v += 3 * LINMATH_BLOCK, r += 3 * LINMATH_BLOCK)
+	{
+		for (int half = 0; half < LINMATH_BLOCK; half += 4)
+			transform4Neon(r + half, r + LINMATH_BLOCK + half, r + 2 * LINMATH_BLOCK + half, M, v + half,
+				v + LINMATH_BLOCK + half, v + 2 * LINMATH_BLOCK + half);
+	}
+}
+
+#else
+
+void mat4x4_mul_vec4_batch(vec4* r, mat4x4 M, const vec4* v, size_t n)
+{
+	mulVec4Scalar(r, M, v, 0, n);
+}
+
+void mat4x4_transform_soa(float* rx, float* ry, float* rz, mat4x4 M, const float* x, const float* y, const float* z,
+	size_t n)
+{
+	transformScalar(rx, ry, rz, M, x, y, z, 0, n);
+}
+
+void mat4x4_transform_aosoa(float* r, mat4x4 M, const float* v, size_t numBlocks)
+{
+	for (size_t b = 0; b < numBlocks; ++b, v += 3 * LINMATH_BLOCK, r += 3 * LINMATH_BLOCK)
+		transformScalar(r, r + LINMATH_BLOCK, r + 2 * LINMATH_BLOCK, M, v, v + LINMATH_BLOCK, v + 2 * LINMATH_BLOCK, 0, LINMATH_BLOCK);
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef LINMATH_BATCH_H
+#define LINMATH_BATCH_H
+
+#include "linmath.h"
+#include <cstddef>
+
+// Transforms of point arrays by a linmath matrix (column major, M[column][row]), for point clouds of millions of
+// points. Vectorized with SSE, AVX2 when the CPU supports it, or NEON. The outputs may be the inputs.
+
+// Points per block of the AoSoA layout: x of the block, then y, then z
+#define LINMATH_BLOCK 8
+
+// r[i] = M * v[i] for n vectors
+void mat4x4_mul_vec4_batch(vec4* r, mat4x4 M, const vec4* v, size_t n);
+
+// Affine transform of n points (w = 1, the last row of M is ignored) in separate x, y and z arrays
+void mat4x4_transform_soa(float* rx, float* ry, float* rz, mat4x4 M, const float* x, const float* y, const float* z,
+	size_t n);
+
+// Affine transform of numBlocks blocks of LINMATH_BLOCK points
+void mat4x4_transform_aosoa(float* r, mat4x4 M, const float* v, size_t numBlocks);
+
+#endif // LINMATH_BATCH_H